@@ -1,9 +1,39 @@
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cerrno>
+#include <charconv>
+#include <climits>
+#include <condition_variable>
 #include <cstdarg>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <filesystem>
 #include <fstream>
+#include <functional>
+#include <future>
 #include <iomanip>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <queue>
+#include <sstream>
 #include <string>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
 #include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
 #include "../third_party/nlohmann/json.hpp"
 
 using json = nlohmann::json;
@@ -11,6 +41,71 @@ using json = nlohmann::json;
 void print_info(int status, const char* function_name);
 void print_debug(const std::string& format, ...);
 
+// Nesting depth of query functions on this thread; only the outermost call is logged
+thread_local int query_log_depth = 0;
+
+// Appends the columns touched by a query to the query log
+// The log is a JSON-lines file named by the HTY_QUERY_LOG environment variable;
+// nothing is recorded when the variable is unset. Failing to log never fails
+// the query: the error is reported on stderr and the entry is dropped.
+// Input: HTY file path, touched column names
+void log_query(const std::string& hty_file_path, const std::vector<std::string>& columns)
+{
+    static const char* query_log_path = std::getenv("HTY_QUERY_LOG");
+    static std::mutex query_log_mutex;
+    static std::ofstream query_log;
+    if (query_log_path == nullptr || columns.empty())
+    {
+        return;
+    }
+
+    try
+    {
+        json entry;
+        entry["hty_file_path"] = std::filesystem::weakly_canonical(hty_file_path).string();
+        entry["columns"] = columns;
+        std::string line = entry.dump() + "\n";
+
+        std::lock_guard<std::mutex> lock(query_log_mutex);
+        if (!query_log.is_open())
+        {
+            query_log.open(query_log_path, std::ios::app);
+            if (!query_log.is_open())
+            {
+                throw std::runtime_error("Unable to open query log");
+            }
+        }
+        query_log << line << std::flush;
+        if (!query_log)
+        {
+            query_log.clear();
+            throw std::runtime_error("Unable to write query log");
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Query log: " << e.what() << std::endl;
+    }
+}
+
+// Logs a query on construction unless it runs inside another logged query
+struct QueryLogScope
+{
+    QueryLogScope(const std::string& hty_file_path, const std::vector<std::string>& columns)
+    {
+        if (query_log_depth == 0)
+        {
+            log_query(hty_file_path, columns);
+        }
+        ++query_log_depth;
+    }
+
+    ~QueryLogScope()
+    {
+        --query_log_depth;
+    }
+};
+
 // Extracts metadata from an HTY file
 // Input: Path to HTY file
 // Output: JSON object containing metadata
@@ -49,6 +144,7 @@ json extract_metadata(std::string hty_file_path)
 std::vector<int> project_single_column(json metadata, std::string hty_file_path, std::string projected_column)
 {
     print_info(0, __func__);
+    QueryLogScope query_log_scope(hty_file_path, {projected_column});
     std::ifstream file(hty_file_path, std::ios::binary);
     if (!file.is_open())
     {
@@ -119,12 +215,39 @@ void display_column(json metadata, std::string column_name, std::vector<int> dat
     print_info(1, __func__);
 }
 
+// Evaluates `a [operation] b` on a raw 32-bit value of a column
+// Input: Raw value, whether the column is a float column, operation code, comparison value
+// Output: Whether the condition holds
+bool compare_value(int a, bool is_float, int operation, float b)
+{
+    float a_float;
+    if (is_float)
+    {
+        std::memcpy(&a_float, &a, sizeof(float));
+    }
+    else
+    {
+        a_float = static_cast<float>(a);
+    }
+    switch (operation)
+    {
+        case 0: return a_float > b;
+        case 1: return a_float >= b;
+        case 2: return a_float < b;
+        case 3: return a_float <= b;
+        case 4: return std::abs(a_float - b) < 1e-6;
+        case 5: return std::abs(a_float - b) >= 1e-6;
+        default: throw std::runtime_error("Invalid operation");
+    }
+}
+
 // Filters data based on a condition
 // Input: Metadata, HTY file path, column to filter, operation, filter value
 // Output: Vector of indices meeting the filter condition
 std::vector<int> filter(json metadata, std::string hty_file_path, std::string filtered_column, int operation, float filtered_value)
 {
     print_info(0 , __func__);
+    QueryLogScope query_log_scope(hty_file_path, {filtered_column});
     std::vector<int> column_data = project_single_column(metadata, hty_file_path, filtered_column);
     print_debug("Column data size: %zu\n", column_data.size());
     std::vector<int> result;
@@ -145,34 +268,11 @@ std::vector<int> filter(json metadata, std::string hty_file_path, std::string fi
     }
     print_debug("Column type: %s\n", column_type.c_str());
 
-    // Define comparison lambda
-    auto compare = [operation, column_type](int a, float b)
-    {
-        float a_float;
-        if (column_type == "float")
-        {
-            std::memcpy(&a_float, &a, sizeof(float));
-        }
-        else
-        {
-            a_float = static_cast<float>(a);
-        }
-        switch (operation)
-        {
-            case 0: return a_float > b;
-            case 1: return a_float >= b;
-            case 2: return a_float < b;
-            case 3: return a_float <= b;
-            case 4: return std::abs(a_float - b) < 1e-6;
-            case 5: return std::abs(a_float - b) >= 1e-6;
-            default: throw std::runtime_error("Invalid operation");
-        }
-    };
-
     // Apply filter
+    bool is_float = (column_type == "float");
     for (size_t i = 0; i < column_data.size(); ++i)
     {
-        if (compare(column_data[i], filtered_value))
+        if (compare_value(column_data[i], is_float, operation, filtered_value))
         {
             result.push_back(i);
         }
@@ -183,78 +283,143 @@ std::vector<int> filter(json metadata, std::string hty_file_path, std::string fi
     return result;
 }
 
+// Reads consecutive bytes of a file into several buffers, with one call per IOV_MAX buffers
+// Input: File descriptor, file offset, target buffers (advanced as they are filled)
+void read_at(int fd, int64_t offset, std::vector<iovec>& buffers)
+{
+    size_t first = 0;
+    while (true)
+    {
+        while (first < buffers.size() && buffers[first].iov_len == 0)
+        {
+            ++first;
+        }
+        if (first == buffers.size())
+        {
+            return;
+        }
+
+        int count = static_cast<int>(std::min<size_t>(buffers.size() - first, IOV_MAX));
+        ssize_t n = preadv(fd, buffers.data() + first, count, offset);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            throw std::runtime_error("Failed to read data at offset " + std::to_string(offset));
+        }
+        offset += n;
+
+        size_t remaining = static_cast<size_t>(n);
+        while (remaining > 0)
+        {
+            size_t taken = std::min(remaining, buffers[first].iov_len);
+            buffers[first].iov_base = static_cast<char*>(buffers[first].iov_base) + taken;
+            buffers[first].iov_len -= taken;
+            remaining -= taken;
+            if (buffers[first].iov_len == 0)
+            {
+                ++first;
+            }
+        }
+    }
+}
+
 // Projects multiple columns from an HTY file
 // Input: Metadata, HTY file path, list of column names
 // Output: Vector of vectors containing projected data
 std::vector<std::vector<int>> project(json metadata, std::string hty_file_path, std::vector<std::string> projected_columns)
 {
     print_info(0, __func__);
-    std::ifstream file(hty_file_path, std::ios::binary);
-    if (!file.is_open())
-    {
-        throw std::runtime_error("Unable to open file");
-    }
-
+    QueryLogScope query_log_scope(hty_file_path, projected_columns);
     int num_rows = metadata["num_rows"].get<int>();
+    int64_t column_bytes = static_cast<int64_t>(num_rows) * sizeof(int);
     print_debug("Number of rows: %d\n", num_rows);
     std::vector<std::vector<int>> result(projected_columns.size(), std::vector<int>(num_rows));
 
-    for (const auto& group : metadata["groups"])
+    // Find the offset of each projected column; columns may live in different groups
+    std::vector<int64_t> offsets(projected_columns.size(), -1);
+    for (size_t i = 0; i < projected_columns.size(); ++i)
     {
-        std::vector<size_t> column_indices;
-        // Find indices of projected columns
-        for (const auto& projected_column : projected_columns)
+        for (const auto& group : metadata["groups"])
         {
-            bool found = false;
-            for (size_t i = 0; i < group["columns"].size(); ++i)
+            for (size_t j = 0; j < group["columns"].size(); ++j)
             {
-                if (group["columns"][i]["column_name"] == projected_column)
+                if (group["columns"][j]["column_name"] == projected_columns[i])
                 {
-                    column_indices.push_back(i);
-                    found = true;
+                    offsets[i] = group["offset"].get<int64_t>() + static_cast<int64_t>(j) * column_bytes;
                     break;
                 }
             }
-            if (!found)
-            {
-                print_debug("Column not found: %s\n", projected_column.c_str());
-            }
+            if (offsets[i] >= 0) break;
         }
+        if (offsets[i] < 0)
+        {
+            throw std::runtime_error("Column not found: " + projected_columns[i]);
+        }
+    }
+
+    int fd = open(hty_file_path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        throw std::runtime_error("Unable to open file");
+    }
 
-        if (column_indices.size() == projected_columns.size())
+    // Read each distinct column once, in file order; columns that are adjacent
+    // in the file (e.g. in the same group) are fetched with a single read
+    std::vector<size_t> order(projected_columns.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&offsets](size_t a, size_t b) { return offsets[a] < offsets[b]; });
+    std::vector<std::pair<size_t, size_t>> duplicates;  // (projected column, column it repeats)
+    try
+    {
+        size_t k = 0;
+        while (k < order.size())
         {
-            // Read data for each column
-            int64_t base_offset = group["offset"].get<int64_t>();
-            for (size_t i = 0; i < column_indices.size(); ++i)
+            int64_t run_offset = offsets[order[k]];
+            int64_t run_end = run_offset;
+            std::vector<iovec> run;
+            size_t last = order[k];
+            while (k < order.size())
             {
-                int64_t column_offset = static_cast<int64_t>(column_indices[i]) * static_cast<int64_t>(num_rows) * sizeof(int);
-                std::string column_type = group["columns"][column_indices[i]]["column_type"].get<std::string>();
-
-                size_t data_size = (column_type == "float") ? sizeof(float) : sizeof(int);
-                int64_t offset = base_offset + column_offset;
-                
-                print_debug("Reading column %s from offset %d\n", projected_columns[i].c_str(), offset);
-                file.seekg(offset, std::ios::beg);
-                if (!file)
+                size_t i = order[k];
+                if (!run.empty() && offsets[i] == offsets[last])
                 {
-                    throw std::runtime_error("Failed to seek to offset " + std::to_string(offset));
+                    duplicates.push_back({i, last});
                 }
-
-                file.read(reinterpret_cast<char*>(result[i].data()), num_rows * sizeof(int));
-
-                if (!file)
+                else if (offsets[i] == run_end)
+                {
+                    run.push_back({result[i].data(), static_cast<size_t>(column_bytes)});
+                    run_end += column_bytes;
+                    last = i;
+                }
+                else
                 {
-                    throw std::runtime_error("Failed to read data for column " + projected_columns[i]);
+                    break;
                 }
+                ++k;
             }
 
-            print_debug("Project result size: %zu x %zu\n", result.size(), result.empty() ? 0 : result[0].size());
-            print_info(1, __func__);
-            return result;
+            print_debug("Reading %zu column(s) from offset %lld\n", run.size(), static_cast<long long>(run_offset));
+            read_at(fd, run_offset, run);
         }
     }
+    catch (const std::exception&)
+    {
+        close(fd);
+        throw;
+    }
+    close(fd);
 
-    throw std::runtime_error("Columns not found in the same group");
+    for (const auto& [column, source] : duplicates)
+    {
+        result[column] = result[source];
+    }
+
+    print_debug("Project result size: %zu x %zu\n", result.size(), result.empty() ? 0 : result[0].size());
+    print_info(1, __func__);
+    return result;
 }
 
 // Projects and filters data
@@ -263,6 +428,9 @@ std::vector<std::vector<int>> project(json metadata, std::string hty_file_path,
 std::vector<std::vector<int>> project_and_filter(json metadata, std::string hty_file_path, std::vector<std::string> projected_columns, std::string filtered_column, int op, float value)
 {
     print_info(0, __func__);
+    std::vector<std::string> touched_columns = projected_columns;
+    touched_columns.push_back(filtered_column);
+    QueryLogScope query_log_scope(hty_file_path, touched_columns);
     std::string columns_str;
     for (const auto& col : projected_columns)
     {
@@ -385,6 +553,9 @@ void display_result_set(json metadata, std::vector<std::string> column_names, st
 // Input: Metadata, original HTY file path, new HTY file path, new rows data
 void add_row(json metadata, std::string hty_file_path, std::string modified_hty_file_path, std::vector<std::vector<int>> rows)
 {
+    // Copying the whole file is not a query; keep its column reads out of the log
+    QueryLogScope query_log_scope(hty_file_path, {});
+
     // Read existing data
     std::vector<std::vector<int>> existing_data;
     for (const auto& group : metadata["groups"])
@@ -398,6 +569,15 @@ void add_row(json metadata, std::string hty_file_path, std::string modified_hty_
     // Update metadata with new row count
     metadata["num_rows"] = metadata["num_rows"].get<int>() + rows.size();
 
+    // Columns are written back to back in metadata order, so every group
+    // starts where the previous one ends at the new row count
+    int64_t group_offset = 0;
+    for (auto& group : metadata["groups"])
+    {
+        group["offset"] = group_offset;
+        group_offset += static_cast<int64_t>(group["columns"].size()) * metadata["num_rows"].get<int64_t>() * static_cast<int64_t>(sizeof(int));
+    }
+
     // Write modified .hty file
     std::ofstream out_file(modified_hty_file_path, std::ios::binary);
     if (!out_file.is_open())
@@ -446,152 +626,1955 @@ std::string operation_to_string(int op)
     }
 }
 
-// Prints function entry/exit information
-void print_info(int status, const char* function_name)
-{
-    const std::string bright_cyan = "\033[1;36m";
-    const std::string reset = "\033[0m";
+// ---------- Server mode ----------
+//
+// `analyze.out --serve <socket_path>` keeps tables open across queries. Each
+// table's metadata is parsed once and every column read is kept resident, so
+// a query only pays for the scan itself. Tables are reopened when their file
+// changes and drop their columns past table_max_resident_bytes. Requests are
+// single text lines over a Unix domain socket (column lists are comma
+// separated, `op` uses the same codes as `filter()`):
+//
+//   META    <hty_file_path>
+//   PROJECT <hty_file_path> <column,...>
+//   FILTER  <hty_file_path> <column> <op> <value>
+//   SELECT  <hty_file_path> <column,...> <filtered_column> <op> <value>
+//   QUIT
+//
+// A response is `OK <num_columns> <num_rows>`, a header line with the column
+// names, the rows as comma-separated values, then `END`. Failures answer
+// `ERR <message>` and keep the connection open.
 
-    std::string msg = (status == 0) ? "Entering" : (status == 1) ? "Exiting" : "Unknown status";
+// Number of rows a shared scan evaluates per predicate before moving on
+const size_t scan_block_rows = 4096;
 
-    std::cout << bright_cyan << "[i] " << msg << " " << function_name << " function" << reset << std::endl;
-}
+// Bytes buffered before a response chunk is written to the socket
+const size_t response_chunk_bytes = 64 * 1024;
 
-// Prints debug information
-void print_debug(const std::string& format, ...)
+// Resident column bytes a table may hold before its columns are dropped
+const size_t table_max_resident_bytes = size_t{1} << 30;
+
+// Minimum number of request workers; shared scans only batch requests that
+// are in flight on separate workers, so even small machines get a few
+const size_t min_server_threads = 4;
+
+// A table kept open by the server
+struct Table
 {
-    const std::string bright_yellow = "\033[1;33m";
-    const std::string reset = "\033[0m";
+    std::string hty_file_path;
+    uintmax_t file_size = 0;  // Size and modification time of the file when it was opened
+    std::filesystem::file_time_type file_time;
+    std::once_flag metadata_loaded;
+    json metadata;
+    std::mutex columns_mutex;
+    std::unordered_map<std::string, std::shared_ptr<const std::vector<int>>> columns;
+    size_t resident_bytes = 0;
+};
 
-    // Prepare the formatted message
-    va_list args;
-    va_start(args, format);
-    char buffer[256];
-    vsnprintf(buffer, sizeof(buffer), format.c_str(), args);
-    va_end(args);
+// A `column [op] value` condition
+struct Predicate
+{
+    int operation;
+    float value;
+};
 
-    std::cout << bright_yellow << "Debug: " << buffer << reset;
-}
+// One pass over a column evaluating every predicate queued on it
+struct SharedScan
+{
+    std::vector<Predicate> predicates;
+    std::vector<std::vector<int>> results;
+    std::string error;
+    bool done = false;
+};
 
-// Main function: demonstrates usage of HTY file operations
-int main()
+// Scans of a single column: at most one running, plus one batch collecting
+// the requests that arrive meanwhile
+struct ScanQueue
 {
-    try
-    {
-        std::string hty_file_path = "test/test.hty";
-        
-        // Test extract_metadata
-        std::cout << std::endl << "----------Metadata----------" << std::endl;
-        json metadata = extract_metadata(hty_file_path);
+    std::shared_ptr<SharedScan> pending;
+    bool running = false;
+};
 
-        // Test project_single_column and display_column
-        std::cout << std::endl << "----------Single column----------" << std::endl;
-        std::string column_name = "salary";
-        std::vector<int> column_data = project_single_column(metadata, hty_file_path, column_name);
-        display_column(metadata, column_name, column_data);
+// Fixed-size pool of worker threads consuming a task queue
+class ThreadPool
+{
+public:
+    explicit ThreadPool(size_t num_threads)
+    {
+        for (size_t i = 0; i < num_threads; ++i)
+        {
+            workers.emplace_back([this] { worker_loop(); });
+        }
+    }
 
-        // Test project and display_result_set for all columns
-        std::cout << std::endl << "----------All Columns----------" << std::endl;
-        std::vector<std::string> all_columns;
-        for (const auto& group : metadata["groups"])
+    ~ThreadPool()
+    {
         {
-            for (const auto& column : group["columns"])
-            {
-                all_columns.push_back(column["column_name"].get<std::string>());
-            }
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
         }
-        std::vector<std::vector<int>> all_data = project(metadata, hty_file_path, all_columns);
-        display_result_set(metadata, all_columns, all_data);
+        cv.notify_all();
+        for (auto& worker : workers)
+        {
+            worker.join();
+        }
+    }
 
-        // Test filter
-        std::cout << std::endl << "----------Filter----------" << std::endl;
-        std::string filter_column = "salary";
-        float filter_value = 50000.0f;
-        int filter_op = 2; // Less than
-        std::vector<int> unfiltered_data = project_single_column(metadata, hty_file_path, filter_column);
-        std::vector<int> filtered_indices = filter(metadata, hty_file_path, filter_column, filter_op, filter_value);
-        std::cout << "Filtered indices (" << filter_column << " " << operation_to_string(filter_op) << " " << filter_value << "): ";
-        for (const auto& index : filtered_indices)
+    void submit(std::function<void()> task)
+    {
         {
-            std::cout << index << " ";
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.push(std::move(task));
         }
-        std::cout << unfiltered_data.size() << std::endl;
-        std::vector<int> result;
-        for (const auto& index : filtered_indices)
+        cv.notify_one();
+    }
+
+private:
+    void worker_loop()
+    {
+        while (true)
         {
-            if (index >= unfiltered_data.size())
+            std::function<void()> task;
             {
-                print_debug("Index out of range: %d\n", index);
-                continue;
+                std::unique_lock<std::mutex> lock(mutex);
+                cv.wait(lock, [this] { return stopping || !tasks.empty(); });
+                if (stopping && tasks.empty())
+                {
+                    return;
+                }
+                task = std::move(tasks.front());
+                tasks.pop();
             }
-            int value = unfiltered_data[index];
-            result.push_back(value);
+            task();
         }
-        display_column(metadata, filter_column, result);
-        std::cout << std::endl;
-
-        // Test project with specific columns
-        std::cout << "----------Project----------" << std::endl;
-        std::vector<std::string> projected_columns = {"id", "salary"};
-        std::vector<std::vector<int>> projected_data = project(metadata, hty_file_path, projected_columns);
-        std::cout << "Projected data size: " << projected_data.size() << " x " << projected_data[0].size() << std::endl;
-        display_result_set(metadata, projected_columns, projected_data);
-
-        // Test project_and_filter
-        std::cout << std::endl << "----------Project and Filter----------" << std::endl;
-        filter_column = "salary";
-        filter_value = 50000.0f;
-        filter_op = 2; // Less than
-        std::vector<std::vector<int>> filtered_data = project_and_filter(metadata, hty_file_path, all_columns, filter_column, filter_op, filter_value);
-        std::cout << "Filtered data (" << filter_column << " " << operation_to_string(filter_op) << " " << filter_value << "):" << std::endl;
-        display_result_set(metadata, all_columns, filtered_data);
-        std::cout << std::endl;
+    }
 
-        // Test add_row
-        std::cout << "----------Add row----------" << std::endl;
-        std::vector<std::vector<int>> new_rows = {
-            {7, 20, [] { float temp = 90000.3f; return *reinterpret_cast<const int*>(&temp); }(), 
-                       [] { float temp = 3.1f; return *reinterpret_cast<const int*>(&temp); }()},
-            {8, 31, [] { float temp = 32000.2f; return *reinterpret_cast<const int*>(&temp); }(), 
-                       [] { float temp = 2.9f; return *reinterpret_cast<const int*>(&temp); }()},
-            {9, 24, [] { float temp = 85000.8f; return *reinterpret_cast<const int*>(&temp); }(), 
-                       [] { float temp = 4.6f; return *reinterpret_cast<const int*>(&temp); }()}
-        };
-        std::string modified_hty_file_path = "test/modified_test.hty";
-        add_row(metadata, hty_file_path, modified_hty_file_path, new_rows);
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool stopping = false;
+};
 
-        // Verify new data
-        json modified_metadata = extract_metadata(modified_hty_file_path);
-        int expected_rows = metadata["num_rows"].get<int>() + new_rows.size();
-        int actual_rows = modified_metadata["num_rows"].get<int>();
-        print_debug("Expected rows: %d, Actual rows: %d\n", expected_rows, actual_rows);
-        assert(actual_rows == expected_rows && "Number of rows mismatch");
+// State shared by all connections of a server
+struct Server
+{
+    std::mutex tables_mutex;
+    std::unordered_map<std::string, std::shared_ptr<Table>> tables;
+    std::mutex scans_mutex;
+    std::condition_variable scans_cv;
+    std::map<std::string, ScanQueue> scans;
+};
 
-        // Display original and modified data
-        all_columns.clear();
-        for (const auto& group : modified_metadata["groups"])
+// Looks up the type of a column
+// Input: Metadata, column name
+// Output: Column type, or an empty string when the column does not exist
+std::string find_column_type(const json& metadata, const std::string& column_name)
+{
+    for (const auto& group : metadata["groups"])
+    {
+        for (const auto& column : group["columns"])
         {
-            for (const auto& column : group["columns"])
+            if (column["column_name"] == column_name)
             {
-                all_columns.push_back(column["column_name"].get<std::string>());
+                return column["column_type"].get<std::string>();
             }
         }
-        std::cout << "\nOriginal data:\n";
-        std::vector<std::vector<int>> original_data = project(metadata, hty_file_path, all_columns);
-        display_result_set(metadata, all_columns, original_data);
-        std::cout << "\nModified data:\n";
-        std::vector<std::vector<int>> modified_data = project(modified_metadata, modified_hty_file_path, all_columns);
-        display_result_set(modified_metadata, all_columns, modified_data);
+    }
+    return "";
+}
 
-        // Verify data integrity
-        print_debug("Verifying new data\n");
-        for (size_t i = 0; i < all_columns.size(); ++i)
+// Returns an open table, parsing its metadata on first use
+// A file whose size or modification time changed since it was opened (e.g.
+// rewritten by add_row or regroup.out) is opened again; requests already
+// running keep the old table until they finish.
+// Input: Server, HTY file path
+// Output: The resident table
+std::shared_ptr<Table> open_table(Server& server, const std::string& hty_file_path)
+{
+    uintmax_t file_size = std::filesystem::file_size(hty_file_path);
+    std::filesystem::file_time_type file_time = std::filesystem::last_write_time(hty_file_path);
+    std::shared_ptr<Table> table;
+    {
+        std::lock_guard<std::mutex> lock(server.tables_mutex);
+        std::shared_ptr<Table>& slot = server.tables[hty_file_path];
+        if (!slot || slot->file_size != file_size || slot->file_time != file_time)
         {
-            std::string column_name = all_columns[i];
-            // Check if original data is preserved
-            assert(std::equal(original_data[i].begin(), original_data[i].end(), modified_data[i].begin()) && 
-                   "Original data not preserved");
-            // Check if new rows are correctly added
+            slot = std::make_shared<Table>();
+            slot->hty_file_path = hty_file_path;
+            slot->file_size = file_size;
+            slot->file_time = file_time;
+        }
+        table = slot;
+    }
+    std::call_once(table->metadata_loaded, [&table] { table->metadata = extract_metadata(table->hty_file_path); });
+    return table;
+}
+
+// Returns a resident column, reading it from the file on first use
+// When the table's resident columns would exceed table_max_resident_bytes,
+// they are all dropped first; requests still using them keep their copies.
+// Input: Table, column name
+// Output: The column data
+std::shared_ptr<const std::vector<int>> load_column(Table& table, const std::string& column_name)
+{
+    std::lock_guard<std::mutex> lock(table.columns_mutex);
+    auto it = table.columns.find(column_name);
+    if (it != table.columns.end())
+    {
+        return it->second;
+    }
+    auto column = std::make_shared<const std::vector<int>>(project_single_column(table.metadata, table.hty_file_path, column_name));
+    size_t column_bytes = column->size() * sizeof(int);
+    if (table.resident_bytes + column_bytes > table_max_resident_bytes)
+    {
+        table.columns.clear();
+        table.resident_bytes = 0;
+    }
+    table.columns.emplace(column_name, column);
+    table.resident_bytes += column_bytes;
+    return column;
+}
+
+// Evaluates all predicates of a shared scan in one pass over the column
+// Input: Column data, whether the column is a float column, scan to fill
+void run_shared_scan(const std::vector<int>& column_data, bool is_float, SharedScan& scan)
+{
+    scan.results.assign(scan.predicates.size(), {});
+    for (size_t begin = 0; begin < column_data.size(); begin += scan_block_rows)
+    {
+        size_t end = std::min(begin + scan_block_rows, column_data.size());
+        for (size_t p = 0; p < scan.predicates.size(); ++p)
+        {
+            const Predicate& predicate = scan.predicates[p];
+            std::vector<int>& result = scan.results[p];
+            for (size_t i = begin; i < end; ++i)
+            {
+                if (compare_value(column_data[i], is_float, predicate.operation, predicate.value))
+                {
+                    result.push_back(static_cast<int>(i));
+                }
+            }
+        }
+    }
+}
+
+// Filters a resident column, sharing the pass with concurrent filters on it
+// Input: Server, table, column to filter, operation, filter value
+// Output: Vector of indices meeting the filter condition
+std::vector<int> shared_filter(Server& server, Table& table, const std::string& filtered_column, int operation, float filtered_value)
+{
+    std::string column_type = find_column_type(table.metadata, filtered_column);
+    if (column_type.empty())
+    {
+        throw std::runtime_error("Column not found: " + filtered_column);
+    }
+    if (operation < 0 || operation > 5)
+    {
+        throw std::runtime_error("Invalid operation");
+    }
+    std::shared_ptr<const std::vector<int>> column_data = load_column(table, filtered_column);
+
+    std::unique_lock<std::mutex> lock(server.scans_mutex);
+    // Key by the table object so a reopened file never shares a scan with its stale copy
+    std::string scan_key = std::to_string(reinterpret_cast<uintptr_t>(&table)) + '\n' + filtered_column;
+    ScanQueue& queue = server.scans[scan_key];
+    std::shared_ptr<SharedScan> scan = queue.pending;
+    size_t slot = 0;
+    if (scan)
+    {
+        // Join the batch waiting for the running scan to finish
+        slot = scan->predicates.size();
+        scan->predicates.push_back({operation, filtered_value});
+        server.scans_cv.wait(lock, [&scan] { return scan->done; });
+    }
+    else
+    {
+        // Lead a new batch; requests arriving until the column is free join it
+        scan = std::make_shared<SharedScan>();
+        scan->predicates.push_back({operation, filtered_value});
+        queue.pending = scan;
+        server.scans_cv.wait(lock, [&queue] { return !queue.running; });
+        queue.pending = nullptr;
+        queue.running = true;
+        lock.unlock();
+
+        try
+        {
+            run_shared_scan(*column_data, column_type == "float", *scan);
+        }
+        catch (const std::exception& e)
+        {
+            scan->error = e.what();
+        }
+
+        lock.lock();
+        queue.running = false;
+        scan->done = true;
+        server.scans_cv.notify_all();
+        // Nobody else refers to an idle queue, and reopened tables would otherwise leave theirs behind
+        if (!queue.pending)
+        {
+            server.scans.erase(scan_key);
+        }
+    }
+
+    if (!scan->error.empty())
+    {
+        throw std::runtime_error(scan->error);
+    }
+    return std::move(scan->results[slot]);
+}
+
+// Writes a whole buffer to a socket
+// Input: Socket, data
+void send_all(int fd, const std::string& data)
+{
+    size_t sent = 0;
+    while (sent < data.size())
+    {
+        ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0)
+        {
+            throw std::runtime_error("Failed to write to client");
+        }
+        sent += static_cast<size_t>(n);
+    }
+}
+
+// Appends a raw 32-bit value as text
+// Input: Output buffer, raw value, whether the value is a float
+void append_value(std::string& out, int value, bool is_float)
+{
+    char buffer[32];
+    std::to_chars_result written;
+    if (is_float)
+    {
+        float float_value;
+        std::memcpy(&float_value, &value, sizeof(float));
+        written = std::to_chars(buffer, buffer + sizeof(buffer), float_value);
+    }
+    else
+    {
+        written = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    }
+    out.append(buffer, written.ptr);
+}
+
+// Streams a result set to a client in chunks
+// Input: Socket, column names, column types, result set columns (not copied)
+void send_result_set(int fd, const std::vector<std::string>& column_names, const std::vector<std::string>& column_types,
+                     const std::vector<const std::vector<int>*>& result_set)
+{
+    size_t num_rows = result_set.empty() ? 0 : result_set[0]->size();
+    std::string out = "OK " + std::to_string(result_set.size()) + " " + std::to_string(num_rows) + "\n";
+    for (size_t col = 0; col < column_names.size(); ++col)
+    {
+        out += (col == 0 ? "" : ",") + column_names[col];
+    }
+    out += "\n";
+
+    std::vector<bool> is_float(column_types.size());
+    for (size_t col = 0; col < column_types.size(); ++col)
+    {
+        is_float[col] = (column_types[col] == "float");
+    }
+    for (size_t row = 0; row < num_rows; ++row)
+    {
+        for (size_t col = 0; col < result_set.size(); ++col)
+        {
+            if (col != 0)
+            {
+                out += ',';
+            }
+            append_value(out, (*result_set[col])[row], is_float[col]);
+        }
+        out += '\n';
+        if (out.size() >= response_chunk_bytes)
+        {
+            send_all(fd, out);
+            out.clear();
+        }
+    }
+    out += "END\n";
+    send_all(fd, out);
+}
+
+// Splits a comma-separated column list
+// Input: Column list
+// Output: Column names
+std::vector<std::string> split_columns(const std::string& column_list)
+{
+    std::vector<std::string> columns;
+    std::istringstream iss(column_list);
+    std::string column;
+    while (std::getline(iss, column, ','))
+    {
+        columns.push_back(column);
+    }
+    return columns;
+}
+
+// Answers a single request line
+// Input: Server, client socket, request line
+// Output: False when the client asked to close the connection
+bool handle_request(Server& server, int fd, const std::string& line)
+{
+    std::istringstream iss(line);
+    std::string command;
+    std::string hty_file_path;
+    iss >> command;
+    if (command.empty())
+    {
+        return true;
+    }
+    if (command == "QUIT")
+    {
+        return false;
+    }
+    if (!(iss >> hty_file_path))
+    {
+        throw std::runtime_error("Missing table path");
+    }
+    std::shared_ptr<Table> table = open_table(server, hty_file_path);
+
+    if (command == "META")
+    {
+        send_all(fd, "OK 1 1\nmetadata\n" + table->metadata.dump() + "\nEND\n");
+        return true;
+    }
+
+    std::vector<std::string> projected_columns;
+    if (command == "PROJECT" || command == "SELECT")
+    {
+        std::string column_list;
+        if (!(iss >> column_list))
+        {
+            throw std::runtime_error("Missing projected columns");
+        }
+        projected_columns = split_columns(column_list);
+    }
+
+    bool filtered = (command == "FILTER" || command == "SELECT");
+    std::string filtered_column;
+    int op = 0;
+    float value = 0;
+    if (filtered && !(iss >> filtered_column >> op >> value))
+    {
+        throw std::runtime_error("Expected <filtered_column> <op> <value>");
+    }
+    else if (!filtered && command != "PROJECT")
+    {
+        throw std::runtime_error("Unknown command: " + command);
+    }
+
+    std::vector<std::string> touched_columns = projected_columns;
+    if (filtered)
+    {
+        touched_columns.push_back(filtered_column);
+    }
+    QueryLogScope query_log_scope(hty_file_path, touched_columns);
+
+    std::vector<int> filtered_indices;
+    if (filtered)
+    {
+        filtered_indices = shared_filter(server, *table, filtered_column, op, value);
+    }
+
+    if (command == "FILTER")
+    {
+        send_result_set(fd, {"index"}, {"int"}, {&filtered_indices});
+        return true;
+    }
+
+    // Unfiltered columns stream straight from resident memory; filtered ones are gathered
+    std::vector<std::string> column_types;
+    std::vector<std::shared_ptr<const std::vector<int>>> columns;
+    for (const auto& column_name : projected_columns)
+    {
+        std::string column_type = find_column_type(table->metadata, column_name);
+        if (column_type.empty())
+        {
+            throw std::runtime_error("Column not found: " + column_name);
+        }
+        column_types.push_back(column_type);
+        std::shared_ptr<const std::vector<int>> column_data = load_column(*table, column_name);
+        if (!filtered)
+        {
+            columns.push_back(column_data);
+            continue;
+        }
+        auto values = std::make_shared<std::vector<int>>();
+        values->reserve(filtered_indices.size());
+        for (const auto& index : filtered_indices)
+        {
+            values->push_back((*column_data)[index]);
+        }
+        columns.push_back(values);
+    }
+
+    std::vector<const std::vector<int>*> result_set;
+    for (const auto& column : columns)
+    {
+        result_set.push_back(column.get());
+    }
+    send_result_set(fd, projected_columns, column_types, result_set);
+    return true;
+}
+
+// Answers a single request line, reporting failures to the client
+// Input: Server, client socket, request line
+// Output: False when the connection should be closed
+bool answer_request(Server& server, int fd, const std::string& line)
+{
+    try
+    {
+        return handle_request(server, fd, line);
+    }
+    catch (const std::exception& e)
+    {
+        try
+        {
+            send_all(fd, std::string("ERR ") + e.what() + "\n");
+        }
+        catch (const std::exception&)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Reads requests from one client until it disconnects
+// Each request runs on the pool; the connection waits for its answer before
+// reading the next one, so responses keep the order of the requests.
+// Input: Server, request workers, client socket
+void handle_connection(Server& server, ThreadPool& pool, int fd)
+{
+    std::string pending;
+    char buffer[4096];
+    bool open = true;
+    while (open)
+    {
+        ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+        if (n <= 0)
+        {
+            break;
+        }
+        pending.append(buffer, static_cast<size_t>(n));
+
+        size_t newline;
+        while (open && (newline = pending.find('\n')) != std::string::npos)
+        {
+            std::string line = pending.substr(0, newline);
+            pending.erase(0, newline + 1);
+            if (!line.empty() && line.back() == '\r')
+            {
+                line.pop_back();
+            }
+
+            std::promise<bool> answered;
+            std::future<bool> keep_open = answered.get_future();
+            pool.submit([&server, fd, &line, &answered] { answered.set_value(answer_request(server, fd, line)); });
+            open = keep_open.get();
+        }
+    }
+    close(fd);
+}
+
+// Runs the query server until the process is terminated
+// Input: Path of the Unix domain socket to listen on
+void run_server(const std::string& socket_path)
+{
+    print_info(0, __func__);
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(address.sun_path))
+    {
+        throw std::runtime_error("Socket path too long");
+    }
+    std::strncpy(address.sun_path, socket_path.c_str(), sizeof(address.sun_path) - 1);
+
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0)
+    {
+        throw std::runtime_error("Unable to create socket");
+    }
+    unlink(socket_path.c_str());
+    if (bind(listen_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 || listen(listen_fd, SOMAXCONN) < 0)
+    {
+        close(listen_fd);
+        throw std::runtime_error("Unable to listen on " + socket_path);
+    }
+
+    // Idle clients only hold their own reader thread, never a request worker
+    Server server;
+    ThreadPool pool(std::max<size_t>(min_server_threads, std::thread::hardware_concurrency()));
+    print_debug("Listening on %s\n", socket_path.c_str());
+    while (true)
+    {
+        int client_fd = accept(listen_fd, nullptr, nullptr);
+        if (client_fd < 0)
+        {
+            continue;
+        }
+        std::thread([&server, &pool, client_fd] { handle_connection(server, pool, client_fd); }).detach();
+    }
+}
+
+// ---------- Arrow C Data Interface export ----------
+//
+// Results are exported as a struct array with one int32 ("i") or float32 ("f")
+// child per column, following https://arrow.apache.org/docs/format/CDataInterface.html.
+// Child buffers point at memory the export keeps alive until the consumer
+// calls `release`: either the mapped `.hty` file or moved-in result vectors.
+
+#ifndef ARROW_C_DATA_INTERFACE
+#define ARROW_C_DATA_INTERFACE
+
+#define ARROW_FLAG_DICTIONARY_ORDERED 1
+#define ARROW_FLAG_NULLABLE 2
+#define ARROW_FLAG_MAP_KEYS_SORTED 4
+
+struct ArrowSchema
+{
+    const char* format;
+    const char* name;
+    const char* metadata;
+    int64_t flags;
+    int64_t n_children;
+    struct ArrowSchema** children;
+    struct ArrowSchema* dictionary;
+    void (*release)(struct ArrowSchema*);
+    void* private_data;
+};
+
+struct ArrowArray
+{
+    int64_t length;
+    int64_t null_count;
+    int64_t offset;
+    int64_t n_buffers;
+    int64_t n_children;
+    const void** buffers;
+    struct ArrowArray** children;
+    struct ArrowArray* dictionary;
+    void (*release)(struct ArrowArray*);
+    void* private_data;
+};
+
+#endif  // ARROW_C_DATA_INTERFACE
+
+// A read-only memory mapping of a whole file
+struct MappedFile
+{
+    const char* data = nullptr;
+    size_t size = 0;
+
+    ~MappedFile()
+    {
+        if (data != nullptr)
+        {
+            munmap(const_cast<char*>(data), size);
+        }
+    }
+};
+
+// Strings and children owned by an exported schema
+struct ArrowSchemaData
+{
+    std::string format;
+    std::string name;
+    std::vector<ArrowSchema> children;
+    std::vector<ArrowSchema*> child_pointers;
+};
+
+// Buffers and children owned by an exported array
+struct ArrowArrayData
+{
+    std::shared_ptr<const void> owner;  // Keeps the memory behind `buffers` alive
+    const void* buffers[2] = {nullptr, nullptr};
+    std::vector<ArrowArray> children;
+    std::vector<ArrowArray*> child_pointers;
+};
+
+// Releases an exported schema and the children the consumer has not moved out
+void release_arrow_schema(ArrowSchema* schema)
+{
+    auto* data = static_cast<ArrowSchemaData*>(schema->private_data);
+    for (auto& child : data->children)
+    {
+        if (child.release != nullptr)
+        {
+            child.release(&child);
+        }
+    }
+    delete data;
+    schema->release = nullptr;
+}
+
+// Releases an exported array and the children the consumer has not moved out
+void release_arrow_array(ArrowArray* array)
+{
+    auto* data = static_cast<ArrowArrayData*>(array->private_data);
+    for (auto& child : data->children)
+    {
+        if (child.release != nullptr)
+        {
+            child.release(&child);
+        }
+    }
+    delete data;
+    array->release = nullptr;
+}
+
+// Fills a schema owning its format and name
+// Input: Schema to fill, Arrow format string, field name, number of children
+// Output: Private data of the schema, for attaching children
+ArrowSchemaData* init_arrow_schema(ArrowSchema* schema, const std::string& format, const std::string& name, size_t n_children)
+{
+    auto* data = new ArrowSchemaData{format, name, std::vector<ArrowSchema>(n_children), {}};
+    for (auto& child : data->children)
+    {
+        data->child_pointers.push_back(&child);
+    }
+    schema->format = data->format.c_str();
+    schema->name = data->name.c_str();
+    schema->metadata = nullptr;
+    schema->flags = 0;
+    schema->n_children = static_cast<int64_t>(n_children);
+    schema->children = n_children == 0 ? nullptr : data->child_pointers.data();
+    schema->dictionary = nullptr;
+    schema->release = release_arrow_schema;
+    schema->private_data = data;
+    return data;
+}
+
+// Fills an array without nulls
+// Input: Array to fill, length, values buffer (null for struct arrays), its owner, number of children
+// Output: Private data of the array, for attaching children
+ArrowArrayData* init_arrow_array(ArrowArray* array, int64_t length, const void* values, std::shared_ptr<const void> owner, size_t n_children)
+{
+    auto* data = new ArrowArrayData{std::move(owner), {nullptr, values}, std::vector<ArrowArray>(n_children), {}};
+    for (auto& child : data->children)
+    {
+        data->child_pointers.push_back(&child);
+    }
+    array->length = length;
+    array->null_count = 0;
+    array->offset = 0;
+    array->n_buffers = n_children == 0 ? 2 : 1;
+    array->n_children = static_cast<int64_t>(n_children);
+    array->buffers = data->buffers;
+    array->children = n_children == 0 ? nullptr : data->child_pointers.data();
+    array->dictionary = nullptr;
+    array->release = release_arrow_array;
+    array->private_data = data;
+    return data;
+}
+
+// Exports columns as an Arrow struct array
+// Input: Column names, column types, pointers to each column's values and their owners, number of rows, output schema and array
+void export_arrow_columns(const std::vector<std::string>& column_names, const std::vector<std::string>& column_types,
+                          const std::vector<const void*>& values, const std::vector<std::shared_ptr<const void>>& owners,
+                          int64_t num_rows, ArrowSchema* out_schema, ArrowArray* out_array)
+{
+    ArrowSchemaData* schema_data = init_arrow_schema(out_schema, "+s", "", column_names.size());
+    ArrowArrayData* array_data = init_arrow_array(out_array, num_rows, nullptr, nullptr, column_names.size());
+    for (size_t i = 0; i < column_names.size(); ++i)
+    {
+        init_arrow_schema(&schema_data->children[i], column_types[i] == "float" ? "f" : "i", column_names[i], 0);
+        init_arrow_array(&array_data->children[i], num_rows, values[i], owners[i], 0);
+    }
+}
+
+// Maps a whole file into memory
+// Input: File path
+// Output: The shared mapping
+std::shared_ptr<const MappedFile> map_file(const std::string& file_path)
+{
+    int fd = open(file_path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        throw std::runtime_error("Unable to open file");
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) < 0)
+    {
+        close(fd);
+        throw std::runtime_error("Unable to stat file");
+    }
+
+    auto mapping = std::make_shared<MappedFile>();
+    mapping->size = static_cast<size_t>(file_stat.st_size);
+    void* data = mmap(nullptr, mapping->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        throw std::runtime_error("Unable to map file");
+    }
+    mapping->data = static_cast<const char*>(data);
+    return mapping;
+}
+
+// Locates a column's data in a mapped HTY file
+// Input: Mapping, metadata, column name, output for the column type
+// Output: Pointer to the column's values inside the mapping
+const int* mapped_column(const MappedFile& mapping, const json& metadata, const std::string& column_name, std::string& column_type)
+{
+    int64_t column_bytes = metadata["num_rows"].get<int64_t>() * static_cast<int64_t>(sizeof(int));
+    for (const auto& group : metadata["groups"])
+    {
+        for (size_t i = 0; i < group["columns"].size(); ++i)
+        {
+            if (group["columns"][i]["column_name"] == column_name)
+            {
+                int64_t offset = group["offset"].get<int64_t>() + static_cast<int64_t>(i) * column_bytes;
+                if (static_cast<size_t>(offset + column_bytes) > mapping.size)
+                {
+                    throw std::runtime_error("Column data out of file bounds: " + column_name);
+                }
+                column_type = group["columns"][i]["column_type"].get<std::string>();
+                return reinterpret_cast<const int*>(mapping.data + offset);
+            }
+        }
+    }
+    throw std::runtime_error("Column not found: " + column_name);
+}
+
+// Projects columns as Arrow arrays pointing directly into the mapped HTY file
+// Input: Metadata, HTY file path, list of column names, output schema and array
+void export_project(json metadata, std::string hty_file_path, std::vector<std::string> projected_columns,
+                    ArrowSchema* out_schema, ArrowArray* out_array)
+{
+    print_info(0, __func__);
+    QueryLogScope query_log_scope(hty_file_path, projected_columns);
+    std::shared_ptr<const MappedFile> mapping = map_file(hty_file_path);
+    int64_t num_rows = metadata["num_rows"].get<int64_t>();
+
+    std::vector<std::string> column_types(projected_columns.size());
+    std::vector<const void*> values;
+    for (size_t i = 0; i < projected_columns.size(); ++i)
+    {
+        values.push_back(mapped_column(*mapping, metadata, projected_columns[i], column_types[i]));
+    }
+
+    std::vector<std::shared_ptr<const void>> owners(projected_columns.size(), mapping);
+    export_arrow_columns(projected_columns, column_types, values, owners, num_rows, out_schema, out_array);
+    print_info(1, __func__);
+}
+
+// Exports a result set as Arrow arrays, handing the column vectors to the export without copying
+// The types are passed in because a result set may hold columns of several
+// tables (hash_join) or computed columns (project_expressions).
+// Input: Column names, column types ("int" or "float"), result set data (moved in), output schema and array
+void export_result_set(std::vector<std::string> column_names, std::vector<std::string> column_types,
+                       std::vector<std::vector<int>> result_set, ArrowSchema* out_schema, ArrowArray* out_array)
+{
+    print_info(0, __func__);
+    if (column_names.size() != result_set.size() || column_types.size() != result_set.size())
+    {
+        throw std::runtime_error("Column names or types do not match the result set");
+    }
+
+    int64_t num_rows = result_set.empty() ? 0 : static_cast<int64_t>(result_set[0].size());
+    std::vector<const void*> values;
+    std::vector<std::shared_ptr<const void>> owners;
+    for (size_t i = 0; i < result_set.size(); ++i)
+    {
+        if (static_cast<int64_t>(result_set[i].size()) != num_rows)
+        {
+            throw std::runtime_error("Result set columns differ in length");
+        }
+        if (column_types[i] != "int" && column_types[i] != "float")
+        {
+            throw std::runtime_error("Unsupported column type for " + column_names[i] + ": " + column_types[i]);
+        }
+        auto column = std::make_shared<const std::vector<int>>(std::move(result_set[i]));
+        values.push_back(column->data());
+        owners.push_back(column);
+    }
+
+    export_arrow_columns(column_names, column_types, values, owners, num_rows, out_schema, out_array);
+    print_info(1, __func__);
+}
+
+// ---------- Hash join ----------
+//
+// Equi-join of two tables on int key columns. Both tables are mapped rather
+// than read, the smaller table is the build side, and its rows are
+// radix-partitioned on the key hash so that each partition's hash table stays
+// cache resident. The other table is probed in parallel morsels; each morsel
+// is partitioned the same way and probed one partition at a time. Filters of
+// either side are applied while scanning, below the join.
+
+// Build rows a partition's hash table aims to hold
+const size_t join_partition_rows = 32 * 1024;
+
+// Upper bound on the radix bits used to partition the build side
+const int join_max_radix_bits = 14;
+
+// Probe rows handled by one task
+const size_t join_morsel_rows = 64 * 1024;
+
+// Marks the end of a hash chain
+const uint32_t join_chain_end = UINT32_MAX;
+
+// A `column [op] value` condition on one table
+struct ColumnFilter
+{
+    std::string column;
+    int operation;
+    float value;
+};
+
+// One table of a join
+struct JoinSide
+{
+    json metadata;
+    std::string hty_file_path;
+    std::string key_column;
+    std::vector<std::string> projected_columns;
+    std::vector<ColumnFilter> filters;
+};
+
+// A build row in its partition
+struct JoinEntry
+{
+    int key;
+    uint32_t row;
+};
+
+// A filter resolved against the mapped table
+struct MappedFilter
+{
+    const int* data;
+    bool is_float;
+    int operation;
+    float value;
+};
+
+// Runs `task(0) .. task(num_tasks - 1)` on all hardware threads
+// Input: Number of tasks, task
+void parallel_for(size_t num_tasks, const std::function<void(size_t)>& task)
+{
+    size_t num_threads = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), num_tasks);
+    std::atomic<size_t> next_task{0};
+    std::vector<std::thread> threads;
+    std::exception_ptr error;
+    std::mutex error_mutex;
+    for (size_t t = 0; t < num_threads; ++t)
+    {
+        threads.emplace_back([&]
+        {
+            size_t i;
+            while ((i = next_task++) < num_tasks)
+            {
+                try
+                {
+                    task(i);
+                }
+                catch (...)
+                {
+                    std::lock_guard<std::mutex> lock(error_mutex);
+                    error = std::current_exception();
+                }
+            }
+        });
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+    if (error)
+    {
+        std::rethrow_exception(error);
+    }
+}
+
+// Hashes a join key
+inline uint64_t hash_join_key(int key)
+{
+    return static_cast<uint64_t>(static_cast<uint32_t>(key)) * 0x9E3779B97F4A7C15ull;
+}
+
+// Resolves the filters of a join side against its mapped table
+// Input: Mapping, join side
+// Output: Filters reading the mapped columns
+std::vector<MappedFilter> map_filters(const MappedFile& mapping, const JoinSide& side)
+{
+    std::vector<MappedFilter> filters;
+    for (const auto& filter : side.filters)
+    {
+        if (filter.operation < 0 || filter.operation > 5)
+        {
+            throw std::runtime_error("Invalid operation");
+        }
+        std::string column_type;
+        const int* data = mapped_column(mapping, side.metadata, filter.column, column_type);
+        filters.push_back({data, column_type == "float", filter.operation, filter.value});
+    }
+    return filters;
+}
+
+// Checks a row against every filter of a join side
+inline bool passes_filters(const std::vector<MappedFilter>& filters, size_t row)
+{
+    for (const auto& filter : filters)
+    {
+        if (!compare_value(filter.data[row], filter.is_float, filter.operation, filter.value))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Maps a join key column, which must hold ints
+const int* mapped_key_column(const MappedFile& mapping, const JoinSide& side)
+{
+    std::string column_type;
+    const int* keys = mapped_column(mapping, side.metadata, side.key_column, column_type);
+    if (column_type != "int")
+    {
+        throw std::runtime_error("Join key must be an int column: " + side.key_column);
+    }
+    return keys;
+}
+
+// Joins two tables on equal key columns
+// Input: Left table, right table
+// Output: Vector of vectors containing the left projected columns followed by the right ones,
+//         one row per matching pair ordered by the probe table's rows
+std::vector<std::vector<int>> hash_join(JoinSide left, JoinSide right)
+{
+    print_info(0, __func__);
+    std::vector<std::string> left_columns = left.projected_columns;
+    left_columns.push_back(left.key_column);
+    for (const auto& filter : left.filters) left_columns.push_back(filter.column);
+    std::vector<std::string> right_columns = right.projected_columns;
+    right_columns.push_back(right.key_column);
+    for (const auto& filter : right.filters) right_columns.push_back(filter.column);
+    QueryLogScope query_log_scope(left.hty_file_path, left_columns);
+    if (query_log_depth == 1)
+    {
+        log_query(right.hty_file_path, right_columns);
+    }
+
+    bool build_is_left = left.metadata["num_rows"].get<int64_t>() <= right.metadata["num_rows"].get<int64_t>();
+    const JoinSide& build = build_is_left ? left : right;
+    const JoinSide& probe = build_is_left ? right : left;
+    std::shared_ptr<const MappedFile> build_mapping = map_file(build.hty_file_path);
+    std::shared_ptr<const MappedFile> probe_mapping = map_file(probe.hty_file_path);
+    const int* build_keys = mapped_key_column(*build_mapping, build);
+    const int* probe_keys = mapped_key_column(*probe_mapping, probe);
+    std::vector<MappedFilter> build_filters = map_filters(*build_mapping, build);
+    std::vector<MappedFilter> probe_filters = map_filters(*probe_mapping, probe);
+    size_t build_rows = build.metadata["num_rows"].get<size_t>();
+    size_t probe_rows = probe.metadata["num_rows"].get<size_t>();
+
+    int radix_bits = 0;
+    while (radix_bits < join_max_radix_bits && (build_rows >> radix_bits) > join_partition_rows)
+    {
+        ++radix_bits;
+    }
+    size_t num_partitions = size_t{1} << radix_bits;
+    auto partition_of = [radix_bits](uint64_t hash) { return radix_bits == 0 ? 0 : static_cast<size_t>(hash >> (64 - radix_bits)); };
+    print_debug("Build rows: %zu, probe rows: %zu, partitions: %zu\n", build_rows, probe_rows, num_partitions);
+
+    // Partition the filtered build rows: histogram per chunk, then scatter
+    size_t num_build_chunks = std::max(1u, std::thread::hardware_concurrency());
+    size_t build_chunk_rows = (build_rows + num_build_chunks - 1) / num_build_chunks;
+    std::vector<std::vector<uint32_t>> histograms(num_build_chunks, std::vector<uint32_t>(num_partitions, 0));
+    parallel_for(num_build_chunks, [&](size_t c)
+    {
+        size_t end = std::min(build_rows, (c + 1) * build_chunk_rows);
+        for (size_t row = c * build_chunk_rows; row < end; ++row)
+        {
+            if (passes_filters(build_filters, row))
+            {
+                histograms[c][partition_of(hash_join_key(build_keys[row]))]++;
+            }
+        }
+    });
+
+    std::vector<size_t> partition_offsets(num_partitions + 1, 0);
+    std::vector<std::vector<size_t>> scatter_offsets(num_build_chunks, std::vector<size_t>(num_partitions));
+    size_t total = 0;
+    for (size_t p = 0; p < num_partitions; ++p)
+    {
+        partition_offsets[p] = total;
+        for (size_t c = 0; c < num_build_chunks; ++c)
+        {
+            scatter_offsets[c][p] = total;
+            total += histograms[c][p];
+        }
+    }
+    partition_offsets[num_partitions] = total;
+
+    std::vector<JoinEntry> entries(total);
+    parallel_for(num_build_chunks, [&](size_t c)
+    {
+        std::vector<size_t>& offsets = scatter_offsets[c];
+        size_t end = std::min(build_rows, (c + 1) * build_chunk_rows);
+        for (size_t row = c * build_chunk_rows; row < end; ++row)
+        {
+            if (passes_filters(build_filters, row))
+            {
+                entries[offsets[partition_of(hash_join_key(build_keys[row]))]++] = {build_keys[row], static_cast<uint32_t>(row)};
+            }
+        }
+    });
+
+    // Build one chained hash table per partition; bucket bits sit right below the radix bits
+    std::vector<size_t> bucket_offsets(num_partitions + 1, 0);
+    std::vector<int> bucket_bits(num_partitions, 0);
+    for (size_t p = 0; p < num_partitions; ++p)
+    {
+        size_t partition_size = partition_offsets[p + 1] - partition_offsets[p];
+        while ((size_t{1} << bucket_bits[p]) < partition_size)
+        {
+            ++bucket_bits[p];
+        }
+        bucket_offsets[p + 1] = bucket_offsets[p] + (size_t{1} << bucket_bits[p]);
+    }
+    auto bucket_of = [radix_bits](uint64_t hash, int bits)
+    {
+        return bits == 0 ? 0 : static_cast<size_t>((hash << radix_bits) >> (64 - bits));
+    };
+    std::vector<uint32_t> heads(bucket_offsets[num_partitions], join_chain_end);
+    std::vector<uint32_t> next(total, join_chain_end);
+    parallel_for(num_partitions, [&](size_t p)
+    {
+        uint32_t* partition_heads = heads.data() + bucket_offsets[p];
+        for (size_t e = partition_offsets[p]; e < partition_offsets[p + 1]; ++e)
+        {
+            size_t bucket = bucket_of(hash_join_key(entries[e].key), bucket_bits[p]);
+            next[e] = partition_heads[bucket];
+            partition_heads[bucket] = static_cast<uint32_t>(e);
+        }
+    });
+
+    // Probe morsels in parallel; each morsel collects (build row, probe row) pairs
+    size_t num_probe_morsels = (probe_rows + join_morsel_rows - 1) / join_morsel_rows;
+    std::vector<std::vector<std::pair<uint32_t, uint32_t>>> matches(num_probe_morsels);
+    parallel_for(num_probe_morsels, [&](size_t m)
+    {
+        size_t begin = m * join_morsel_rows;
+        size_t end = std::min(probe_rows, begin + join_morsel_rows);
+        std::vector<uint32_t> counts(num_partitions + 1, 0);
+        std::vector<uint64_t> hashes(end - begin);
+        std::vector<char> selected(end - begin);
+        for (size_t row = begin; row < end; ++row)
+        {
+            selected[row - begin] = passes_filters(probe_filters, row);
+            if (selected[row - begin])
+            {
+                hashes[row - begin] = hash_join_key(probe_keys[row]);
+                counts[partition_of(hashes[row - begin]) + 1]++;
+            }
+        }
+        for (size_t p = 0; p < num_partitions; ++p)
+        {
+            counts[p + 1] += counts[p];
+        }
+        std::vector<uint32_t> partitioned_rows(counts[num_partitions]);
+        std::vector<uint32_t> fill(counts.begin(), counts.end() - 1);
+        for (size_t row = begin; row < end; ++row)
+        {
+            if (selected[row - begin])
+            {
+                partitioned_rows[fill[partition_of(hashes[row - begin])]++] = static_cast<uint32_t>(row);
+            }
+        }
+
+        std::vector<std::pair<uint32_t, uint32_t>>& morsel_matches = matches[m];
+        for (size_t p = 0; p < num_partitions; ++p)
+        {
+            const uint32_t* partition_heads = heads.data() + bucket_offsets[p];
+            for (size_t i = counts[p]; i < counts[p + 1]; ++i)
+            {
+                uint32_t row = partitioned_rows[i];
+                int key = probe_keys[row];
+                for (uint32_t e = partition_heads[bucket_of(hashes[row - begin], bucket_bits[p])]; e != join_chain_end; e = next[e])
+                {
+                    if (entries[e].key == key)
+                    {
+                        morsel_matches.push_back({entries[e].row, row});
+                    }
+                }
+            }
+        }
+        std::sort(morsel_matches.begin(), morsel_matches.end(),
+                  [](const auto& a, const auto& b) { return a.second != b.second ? a.second < b.second : a.first < b.first; });
+    });
+
+    // Gather the projected columns of every matching pair
+    std::vector<size_t> output_offsets(num_probe_morsels + 1, 0);
+    for (size_t m = 0; m < num_probe_morsels; ++m)
+    {
+        output_offsets[m + 1] = output_offsets[m] + matches[m].size();
+    }
+    size_t num_output_rows = output_offsets[num_probe_morsels];
+
+    struct OutputColumn
+    {
+        const int* data;
+        bool from_build;
+    };
+    std::vector<OutputColumn> output_columns;
+    for (const JoinSide* side : {&left, &right})
+    {
+        bool from_build = (side == &build);
+        const MappedFile& mapping = from_build ? *build_mapping : *probe_mapping;
+        for (const auto& column_name : side->projected_columns)
+        {
+            std::string column_type;
+            output_columns.push_back({mapped_column(mapping, side->metadata, column_name, column_type), from_build});
+        }
+    }
+
+    std::vector<std::vector<int>> result(output_columns.size(), std::vector<int>(num_output_rows));
+    parallel_for(num_probe_morsels, [&](size_t m)
+    {
+        for (size_t c = 0; c < output_columns.size(); ++c)
+        {
+            int* out = result[c].data() + output_offsets[m];
+            const int* data = output_columns[c].data;
+            if (output_columns[c].from_build)
+            {
+                for (const auto& match : matches[m]) *out++ = data[match.first];
+            }
+            else
+            {
+                for (const auto& match : matches[m]) *out++ = data[match.second];
+            }
+        }
+        std::vector<std::pair<uint32_t, uint32_t>>().swap(matches[m]);
+    });
+
+    print_debug("Join result size: %zu x %zu\n", result.size(), num_output_rows);
+    print_info(1, __func__);
+    return result;
+}
+
+// ---------- Expressions ----------
+//
+// Computed columns and predicates are expression trees over columns and
+// literals. An expression is compiled once into a list of typed kernels, one
+// per operator, and every kernel runs over a batch of rows at a time, so rows
+// are never interpreted one by one. Ints are promoted to floats when mixed;
+// comparisons and boolean logic produce 0/1 "bool" values.
+
+// Rows evaluated per kernel call
+const size_t expr_batch_rows = 1024;
+
+// Rows handled by one parallel task
+const size_t expr_morsel_rows = 64 * 1024;
+
+// Kinds of expression nodes
+enum class ExprKind
+{
+    Column,
+    IntLiteral,
+    FloatLiteral,
+    Add,
+    Subtract,
+    Multiply,
+    Divide,
+    Greater,
+    GreaterEqual,
+    Less,
+    LessEqual,
+    Equal,
+    NotEqual,
+    And,
+    Or,
+    Not,
+    CastInt,
+    CastFloat
+};
+
+// A node of an expression tree
+struct Expr
+{
+    ExprKind kind;
+    std::string column;
+    int int_value = 0;
+    float float_value = 0;
+    std::vector<std::shared_ptr<const Expr>> operands;
+};
+
+using ExprPtr = std::shared_ptr<const Expr>;
+
+ExprPtr expr_column(const std::string& column_name)
+{
+    return std::make_shared<const Expr>(Expr{ExprKind::Column, column_name, 0, 0, {}});
+}
+
+ExprPtr expr_literal(int value)
+{
+    return std::make_shared<const Expr>(Expr{ExprKind::IntLiteral, "", value, 0, {}});
+}
+
+ExprPtr expr_literal(float value)
+{
+    return std::make_shared<const Expr>(Expr{ExprKind::FloatLiteral, "", 0, value, {}});
+}
+
+// Float columns hold float32, so double literals are narrowed to float
+ExprPtr expr_literal(double value)
+{
+    return expr_literal(static_cast<float>(value));
+}
+
+// Builds `Not`, `CastInt` or `CastFloat` of an operand
+ExprPtr expr_unary(ExprKind kind, ExprPtr operand)
+{
+    return std::make_shared<const Expr>(Expr{kind, "", 0, 0, {std::move(operand)}});
+}
+
+// Builds an arithmetic, comparison or boolean operator
+ExprPtr expr_binary(ExprKind kind, ExprPtr left, ExprPtr right)
+{
+    return std::make_shared<const Expr>(Expr{kind, "", 0, 0, {std::move(left), std::move(right)}});
+}
+
+// Applies an operator to a batch: out[i] = left[i] op right[i] (right is unused by unary kernels)
+using ExprKernel = void (*)(const void* left, const void* right, void* out, size_t n);
+
+// A batch value of a compiled expression: a column, a broadcast literal or a temporary
+struct ExprRegister
+{
+    int column = -1;            // Index into CompiledExpr::columns when bound to a column
+    std::vector<int> constant;  // Literal repeated over a batch, when not empty
+};
+
+// One kernel call of a compiled expression
+struct ExprStep
+{
+    ExprKernel kernel;
+    size_t left;
+    size_t right;
+    size_t out;
+};
+
+// Expressions compiled into kernels over shared registers
+struct CompiledExpr
+{
+    std::vector<std::string> columns;
+    std::vector<ExprRegister> registers;
+    std::vector<ExprStep> steps;
+    std::vector<size_t> outputs;            // Register holding each compiled expression
+    std::vector<std::string> output_types;  // "int" | "float" | "bool"
+};
+
+// Int arithmetic wraps around on overflow (computed in unsigned), floats follow IEEE
+template <typename T>
+struct ExprAdd
+{
+    T operator()(T a, T b) const
+    {
+        if constexpr (std::is_integral_v<T>) return static_cast<T>(static_cast<unsigned>(a) + static_cast<unsigned>(b));
+        else return a + b;
+    }
+};
+
+template <typename T>
+struct ExprSubtract
+{
+    T operator()(T a, T b) const
+    {
+        if constexpr (std::is_integral_v<T>) return static_cast<T>(static_cast<unsigned>(a) - static_cast<unsigned>(b));
+        else return a - b;
+    }
+};
+
+template <typename T>
+struct ExprMultiply
+{
+    T operator()(T a, T b) const
+    {
+        if constexpr (std::is_integral_v<T>) return static_cast<T>(static_cast<unsigned>(a) * static_cast<unsigned>(b));
+        else return a * b;
+    }
+};
+
+template <typename T>
+struct ExprDivide
+{
+    T operator()(T a, T b) const
+    {
+        if constexpr (std::is_integral_v<T>)
+        {
+            // Integer division by zero yields 0 and INT_MIN / -1 wraps instead of trapping
+            if (b == 0) return 0;
+            if (b == -1) return static_cast<T>(0u - static_cast<unsigned>(a));
+        }
+        return a / b;
+    }
+};
+
+template <typename T>
+struct ExprEqual
+{
+    bool operator()(T a, T b) const
+    {
+        // Floats compare like filter() does
+        if constexpr (std::is_floating_point_v<T>) return std::abs(a - b) < 1e-6;
+        else return a == b;
+    }
+};
+
+template <typename T>
+struct ExprNotEqual
+{
+    bool operator()(T a, T b) const
+    {
+        return !ExprEqual<T>{}(a, b);
+    }
+};
+
+template <typename T, typename R, typename Op>
+void binary_kernel(const void* left, const void* right, void* out, size_t n)
+{
+    const T* a = static_cast<const T*>(left);
+    const T* b = static_cast<const T*>(right);
+    R* result = static_cast<R*>(out);
+    Op op;
+    for (size_t i = 0; i < n; ++i)
+    {
+        result[i] = static_cast<R>(op(a[i], b[i]));
+    }
+}
+
+template <typename T, typename R>
+void cast_kernel(const void* in, const void*, void* out, size_t n)
+{
+    const T* a = static_cast<const T*>(in);
+    R* result = static_cast<R*>(out);
+    for (size_t i = 0; i < n; ++i)
+    {
+        result[i] = static_cast<R>(a[i]);
+    }
+}
+
+// Casts floats to ints, truncating toward zero; NaN becomes 0 and values
+// outside the int range clamp to INT_MIN / INT_MAX
+void float_to_int_kernel(const void* in, const void*, void* out, size_t n)
+{
+    const float* a = static_cast<const float*>(in);
+    int* result = static_cast<int*>(out);
+    for (size_t i = 0; i < n; ++i)
+    {
+        float value = a[i];
+        if (value != value)
+        {
+            result[i] = 0;
+        }
+        else if (value >= 2147483648.0f)
+        {
+            result[i] = INT_MAX;
+        }
+        else if (value <= -2147483648.0f)
+        {
+            result[i] = INT_MIN;
+        }
+        else
+        {
+            result[i] = static_cast<int>(value);
+        }
+    }
+}
+
+void not_kernel(const void* in, const void*, void* out, size_t n)
+{
+    const int* a = static_cast<const int*>(in);
+    int* result = static_cast<int*>(out);
+    for (size_t i = 0; i < n; ++i)
+    {
+        result[i] = !a[i];
+    }
+}
+
+// Picks the kernel of an arithmetic or comparison operator on operands of type T
+template <typename T>
+ExprKernel select_kernel(ExprKind kind)
+{
+    switch (kind)
+    {
+        case ExprKind::Add: return binary_kernel<T, T, ExprAdd<T>>;
+        case ExprKind::Subtract: return binary_kernel<T, T, ExprSubtract<T>>;
+        case ExprKind::Multiply: return binary_kernel<T, T, ExprMultiply<T>>;
+        case ExprKind::Divide: return binary_kernel<T, T, ExprDivide<T>>;
+        case ExprKind::Greater: return binary_kernel<T, int, std::greater<T>>;
+        case ExprKind::GreaterEqual: return binary_kernel<T, int, std::greater_equal<T>>;
+        case ExprKind::Less: return binary_kernel<T, int, std::less<T>>;
+        case ExprKind::LessEqual: return binary_kernel<T, int, std::less_equal<T>>;
+        case ExprKind::Equal: return binary_kernel<T, int, ExprEqual<T>>;
+        case ExprKind::NotEqual: return binary_kernel<T, int, ExprNotEqual<T>>;
+        default: throw std::runtime_error("Invalid expression operator");
+    }
+}
+
+// Adds a register to a compiled expression
+// Output: Index of the register
+size_t add_register(CompiledExpr& program, ExprRegister expr_register)
+{
+    program.registers.push_back(std::move(expr_register));
+    return program.registers.size() - 1;
+}
+
+// Adds a kernel call writing a new temporary register
+// Output: Index of the temporary register
+size_t add_step(CompiledExpr& program, ExprKernel kernel, size_t left, size_t right)
+{
+    size_t out = add_register(program, {});
+    program.steps.push_back({kernel, left, right, out});
+    return out;
+}
+
+// Compiles an expression node and its operands
+// Input: Expression, metadata, program to extend, output for the expression type
+// Output: Register holding the expression's value
+size_t compile_node(const Expr& expr, const json& metadata, CompiledExpr& program, std::string& type)
+{
+    switch (expr.kind)
+    {
+        case ExprKind::Column:
+        {
+            type = find_column_type(metadata, expr.column);
+            if (type.empty())
+            {
+                throw std::runtime_error("Column not found: " + expr.column);
+            }
+            for (size_t r = 0; r < program.registers.size(); ++r)
+            {
+                int column = program.registers[r].column;
+                if (column >= 0 && program.columns[column] == expr.column)
+                {
+                    return r;
+                }
+            }
+            program.columns.push_back(expr.column);
+            return add_register(program, {static_cast<int>(program.columns.size() - 1), {}});
+        }
+        case ExprKind::IntLiteral:
+        {
+            type = "int";
+            return add_register(program, {-1, std::vector<int>(expr_batch_rows, expr.int_value)});
+        }
+        case ExprKind::FloatLiteral:
+        {
+            type = "float";
+            int bits;
+            std::memcpy(&bits, &expr.float_value, sizeof(int));
+            return add_register(program, {-1, std::vector<int>(expr_batch_rows, bits)});
+        }
+        case ExprKind::Not:
+        {
+            size_t operand = compile_node(*expr.operands.at(0), metadata, program, type);
+            if (type != "bool")
+            {
+                throw std::runtime_error("NOT needs a boolean operand");
+            }
+            return add_step(program, not_kernel, operand, operand);
+        }
+        case ExprKind::CastInt:
+        case ExprKind::CastFloat:
+        {
+            size_t operand = compile_node(*expr.operands.at(0), metadata, program, type);
+            std::string target = (expr.kind == ExprKind::CastInt) ? "int" : "float";
+            bool stored_as_int = (type != "float");
+            std::string source = type;
+            type = target;
+            if (source == target || (source == "bool" && target == "int"))
+            {
+                return operand;
+            }
+            return add_step(program, stored_as_int ? cast_kernel<int, float> : float_to_int_kernel, operand, operand);
+        }
+        case ExprKind::And:
+        case ExprKind::Or:
+        {
+            std::string left_type;
+            std::string right_type;
+            size_t left = compile_node(*expr.operands.at(0), metadata, program, left_type);
+            size_t right = compile_node(*expr.operands.at(1), metadata, program, right_type);
+            if (left_type != "bool" || right_type != "bool")
+            {
+                throw std::runtime_error("AND/OR need boolean operands");
+            }
+            type = "bool";
+            ExprKernel kernel = (expr.kind == ExprKind::And) ? binary_kernel<int, int, std::bit_and<int>>
+                                                             : binary_kernel<int, int, std::bit_or<int>>;
+            return add_step(program, kernel, left, right);
+        }
+        default:
+        {
+            std::string left_type;
+            std::string right_type;
+            size_t left = compile_node(*expr.operands.at(0), metadata, program, left_type);
+            size_t right = compile_node(*expr.operands.at(1), metadata, program, right_type);
+            if (left_type == "bool" || right_type == "bool")
+            {
+                throw std::runtime_error("Arithmetic and comparisons need numeric operands");
+            }
+
+            // Promote the int side of a mixed expression to float
+            bool is_float = (left_type == "float" || right_type == "float");
+            if (is_float && left_type == "int")
+            {
+                left = add_step(program, cast_kernel<int, float>, left, left);
+            }
+            if (is_float && right_type == "int")
+            {
+                right = add_step(program, cast_kernel<int, float>, right, right);
+            }
+
+            bool is_comparison = (expr.kind >= ExprKind::Greater && expr.kind <= ExprKind::NotEqual);
+            type = is_comparison ? "bool" : (is_float ? "float" : "int");
+            ExprKernel kernel = is_float ? select_kernel<float>(expr.kind) : select_kernel<int>(expr.kind);
+            return add_step(program, kernel, left, right);
+        }
+    }
+}
+
+// Compiles expressions into one program sharing their column registers
+// Input: Metadata, expressions
+// Output: The compiled program; its steps run in the order of the expressions
+CompiledExpr compile_expressions(const json& metadata, const std::vector<ExprPtr>& exprs)
+{
+    CompiledExpr program;
+    for (const auto& expr : exprs)
+    {
+        std::string type;
+        program.outputs.push_back(compile_node(*expr, metadata, program, type));
+        program.output_types.push_back(type);
+    }
+    return program;
+}
+
+// Returns the type of an expression's values
+// Input: Metadata, expression
+// Output: "int" | "float" | "bool"
+std::string expression_type(json metadata, ExprPtr expr)
+{
+    return compile_expressions(metadata, {expr}).output_types[0];
+}
+
+// Evaluates expressions over an HTY file
+// This is the computed-column form of project_and_filter: the predicate may be any boolean expression.
+// Input: Metadata, HTY file path, expressions to project, predicate keeping rows (null keeps every row)
+// Output: Vector of vectors containing one computed column per projected expression
+std::vector<std::vector<int>> project_expressions(json metadata, std::string hty_file_path, std::vector<ExprPtr> projections, ExprPtr predicate)
+{
+    print_info(0, __func__);
+    std::vector<ExprPtr> exprs;
+    if (predicate)
+    {
+        exprs.push_back(predicate);
+    }
+    exprs.insert(exprs.end(), projections.begin(), projections.end());
+    CompiledExpr program = compile_expressions(metadata, exprs);
+    if (predicate && program.output_types[0] != "bool")
+    {
+        throw std::runtime_error("Predicate must be a boolean expression");
+    }
+    QueryLogScope query_log_scope(hty_file_path, program.columns);
+
+    // Steps up to the predicate's output run first, so batches without a match skip the projections
+    size_t predicate_steps = 0;
+    if (predicate)
+    {
+        while (predicate_steps < program.steps.size() && program.steps[predicate_steps].out <= program.outputs[0])
+        {
+            ++predicate_steps;
+        }
+    }
+
+    std::shared_ptr<const MappedFile> mapping = map_file(hty_file_path);
+    std::vector<const int*> column_data;
+    for (const auto& column_name : program.columns)
+    {
+        std::string column_type;
+        column_data.push_back(mapped_column(*mapping, metadata, column_name, column_type));
+    }
+
+    size_t num_rows = metadata["num_rows"].get<size_t>();
+    size_t num_morsels = (num_rows + expr_morsel_rows - 1) / expr_morsel_rows;
+    size_t first_projection = predicate ? 1 : 0;
+    std::vector<std::vector<std::vector<int>>> morsel_results(num_morsels);
+    parallel_for(num_morsels, [&](size_t m)
+    {
+        // Registers of this task: columns point into the mapping, temporaries own a batch
+        std::vector<std::vector<int>> temporaries(program.registers.size());
+        std::vector<void*> values(program.registers.size());
+        for (size_t r = 0; r < program.registers.size(); ++r)
+        {
+            const ExprRegister& expr_register = program.registers[r];
+            if (!expr_register.constant.empty())
+            {
+                values[r] = const_cast<int*>(expr_register.constant.data());
+            }
+            else if (expr_register.column < 0)
+            {
+                temporaries[r].resize(expr_batch_rows);
+                values[r] = temporaries[r].data();
+            }
+        }
+
+        std::vector<std::vector<int>>& result = morsel_results[m];
+        result.resize(projections.size());
+        size_t end = std::min(num_rows, (m + 1) * expr_morsel_rows);
+        for (size_t begin = m * expr_morsel_rows; begin < end; begin += expr_batch_rows)
+        {
+            size_t n = std::min(expr_batch_rows, end - begin);
+            for (size_t r = 0; r < program.registers.size(); ++r)
+            {
+                if (program.registers[r].column >= 0)
+                {
+                    values[r] = const_cast<int*>(column_data[program.registers[r].column] + begin);
+                }
+            }
+
+            for (size_t s = 0; s < predicate_steps; ++s)
+            {
+                const ExprStep& step = program.steps[s];
+                step.kernel(values[step.left], values[step.right], values[step.out], n);
+            }
+            const int* selected = predicate ? static_cast<const int*>(values[program.outputs[0]]) : nullptr;
+            if (selected != nullptr && std::none_of(selected, selected + n, [](int flag) { return flag != 0; }))
+            {
+                continue;
+            }
+            for (size_t s = predicate_steps; s < program.steps.size(); ++s)
+            {
+                const ExprStep& step = program.steps[s];
+                step.kernel(values[step.left], values[step.right], values[step.out], n);
+            }
+
+            for (size_t p = 0; p < projections.size(); ++p)
+            {
+                const int* column = static_cast<const int*>(values[program.outputs[first_projection + p]]);
+                if (selected == nullptr)
+                {
+                    result[p].insert(result[p].end(), column, column + n);
+                    continue;
+                }
+                for (size_t i = 0; i < n; ++i)
+                {
+                    if (selected[i])
+                    {
+                        result[p].push_back(column[i]);
+                    }
+                }
+            }
+        }
+    });
+
+    std::vector<std::vector<int>> result(projections.size());
+    for (size_t p = 0; p < projections.size(); ++p)
+    {
+        size_t total = 0;
+        for (const auto& morsel : morsel_results) total += morsel[p].size();
+        result[p].reserve(total);
+        for (const auto& morsel : morsel_results)
+        {
+            result[p].insert(result[p].end(), morsel[p].begin(), morsel[p].end());
+        }
+    }
+
+    print_debug("Expression result size: %zu x %zu\n", result.size(), result.empty() ? 0 : result[0].size());
+    print_info(1, __func__);
+    return result;
+}
+
+// Prints function entry/exit information
+void print_info(int status, const char* function_name)
+{
+    const std::string bright_cyan = "\033[1;36m";
+    const std::string reset = "\033[0m";
+
+    std::string msg = (status == 0) ? "Entering" : (status == 1) ? "Exiting" : "Unknown status";
+
+    std::cout << bright_cyan << "[i] " << msg << " " << function_name << " function" << reset << std::endl;
+}
+
+// Prints debug information
+void print_debug(const std::string& format, ...)
+{
+    const std::string bright_yellow = "\033[1;33m";
+    const std::string reset = "\033[0m";
+
+    // Prepare the formatted message
+    va_list args;
+    va_start(args, format);
+    char buffer[256];
+    vsnprintf(buffer, sizeof(buffer), format.c_str(), args);
+    va_end(args);
+
+    std::cout << bright_yellow << "Debug: " << buffer << reset;
+}
+
+// Main function: demonstrates usage of HTY file operations
+int main(int argc, char* argv[])
+{
+    try
+    {
+        if (argc == 3 && std::string(argv[1]) == "--serve")
+        {
+            run_server(argv[2]);
+            return 0;
+        }
+        if (argc != 1)
+        {
+            std::cerr << "Usage: " << argv[0] << " [--serve <socket_path>]" << std::endl;
+            return 1;
+        }
+
+        std::string hty_file_path = "test/test.hty";
+        
+        // Test extract_metadata
+        std::cout << std::endl << "----------Metadata----------" << std::endl;
+        json metadata = extract_metadata(hty_file_path);
+
+        // Test project_single_column and display_column
+        std::cout << std::endl << "----------Single column----------" << std::endl;
+        std::string column_name = "salary";
+        std::vector<int> column_data = project_single_column(metadata, hty_file_path, column_name);
+        display_column(metadata, column_name, column_data);
+
+        // Test project and display_result_set for all columns
+        std::cout << std::endl << "----------All Columns----------" << std::endl;
+        std::vector<std::string> all_columns;
+        for (const auto& group : metadata["groups"])
+        {
+            for (const auto& column : group["columns"])
+            {
+                all_columns.push_back(column["column_name"].get<std::string>());
+            }
+        }
+        std::vector<std::vector<int>> all_data = project(metadata, hty_file_path, all_columns);
+        display_result_set(metadata, all_columns, all_data);
+
+        // Test filter
+        std::cout << std::endl << "----------Filter----------" << std::endl;
+        std::string filter_column = "salary";
+        float filter_value = 50000.0f;
+        int filter_op = 2; // Less than
+        std::vector<int> unfiltered_data = project_single_column(metadata, hty_file_path, filter_column);
+        std::vector<int> filtered_indices = filter(metadata, hty_file_path, filter_column, filter_op, filter_value);
+        std::cout << "Filtered indices (" << filter_column << " " << operation_to_string(filter_op) << " " << filter_value << "): ";
+        for (const auto& index : filtered_indices)
+        {
+            std::cout << index << " ";
+        }
+        std::cout << unfiltered_data.size() << std::endl;
+        std::vector<int> result;
+        for (const auto& index : filtered_indices)
+        {
+            if (index >= unfiltered_data.size())
+            {
+                print_debug("Index out of range: %d\n", index);
+                continue;
+            }
+            int value = unfiltered_data[index];
+            result.push_back(value);
+        }
+        display_column(metadata, filter_column, result);
+        std::cout << std::endl;
+
+        // Test project with specific columns
+        std::cout << "----------Project----------" << std::endl;
+        std::vector<std::string> projected_columns = {"id", "salary"};
+        std::vector<std::vector<int>> projected_data = project(metadata, hty_file_path, projected_columns);
+        std::cout << "Projected data size: " << projected_data.size() << " x " << projected_data[0].size() << std::endl;
+        display_result_set(metadata, projected_columns, projected_data);
+
+        // Test project_and_filter
+        std::cout << std::endl << "----------Project and Filter----------" << std::endl;
+        filter_column = "salary";
+        filter_value = 50000.0f;
+        filter_op = 2; // Less than
+        std::vector<std::vector<int>> filtered_data = project_and_filter(metadata, hty_file_path, all_columns, filter_column, filter_op, filter_value);
+        std::cout << "Filtered data (" << filter_column << " " << operation_to_string(filter_op) << " " << filter_value << "):" << std::endl;
+        display_result_set(metadata, all_columns, filtered_data);
+        std::cout << std::endl;
+
+        // Test export_project and export_result_set
+        std::cout << "----------Arrow Export----------" << std::endl;
+        ArrowSchema schema;
+        ArrowArray array;
+        export_project(metadata, hty_file_path, all_columns, &schema, &array);
+        print_debug("Exported %lld x %lld as %s\n", static_cast<long long>(array.n_children), static_cast<long long>(array.length), schema.format);
+        assert(array.n_children == static_cast<int64_t>(all_columns.size()) && "Arrow column count mismatch");
+        for (size_t i = 0; i < all_columns.size(); ++i)
+        {
+            assert(schema.children[i]->name == all_columns[i] && "Arrow column name mismatch");
+            assert(std::memcmp(array.children[i]->buffers[1], all_data[i].data(), all_data[i].size() * sizeof(int)) == 0 &&
+                   "Arrow column data mismatch");
+        }
+        array.release(&array);
+        schema.release(&schema);
+
+        std::vector<std::vector<int>> exported_data = filtered_data;
+        export_result_set(all_columns, {"int", "int", "float", "float"}, std::move(exported_data), &schema, &array);
+        assert(array.length == static_cast<int64_t>(filtered_data[0].size()) && "Arrow row count mismatch");
+        for (size_t i = 0; i < all_columns.size(); ++i)
+        {
+            assert(std::memcmp(array.children[i]->buffers[1], filtered_data[i].data(), filtered_data[i].size() * sizeof(int)) == 0 &&
+                   "Arrow result set data mismatch");
+        }
+        array.release(&array);
+        schema.release(&schema);
+        std::cout << std::endl;
+
+        // Test add_row
+        std::cout << "----------Add row----------" << std::endl;
+        std::vector<std::vector<int>> new_rows = {
+            {7, 20, [] { float temp = 90000.3f; return *reinterpret_cast<const int*>(&temp); }(), 
+                       [] { float temp = 3.1f; return *reinterpret_cast<const int*>(&temp); }()},
+            {8, 31, [] { float temp = 32000.2f; return *reinterpret_cast<const int*>(&temp); }(), 
+                       [] { float temp = 2.9f; return *reinterpret_cast<const int*>(&temp); }()},
+            {9, 24, [] { float temp = 85000.8f; return *reinterpret_cast<const int*>(&temp); }(), 
+                       [] { float temp = 4.6f; return *reinterpret_cast<const int*>(&temp); }()}
+        };
+        std::string modified_hty_file_path = "test/modified_test.hty";
+        add_row(metadata, hty_file_path, modified_hty_file_path, new_rows);
+
+        // Verify new data
+        json modified_metadata = extract_metadata(modified_hty_file_path);
+        int expected_rows = metadata["num_rows"].get<int>() + new_rows.size();
+        int actual_rows = modified_metadata["num_rows"].get<int>();
+        print_debug("Expected rows: %d, Actual rows: %d\n", expected_rows, actual_rows);
+        assert(actual_rows == expected_rows && "Number of rows mismatch");
+
+        // Display original and modified data
+        all_columns.clear();
+        for (const auto& group : modified_metadata["groups"])
+        {
+            for (const auto& column : group["columns"])
+            {
+                all_columns.push_back(column["column_name"].get<std::string>());
+            }
+        }
+        std::cout << "\nOriginal data:\n";
+        std::vector<std::vector<int>> original_data = project(metadata, hty_file_path, all_columns);
+        display_result_set(metadata, all_columns, original_data);
+        std::cout << "\nModified data:\n";
+        std::vector<std::vector<int>> modified_data = project(modified_metadata, modified_hty_file_path, all_columns);
+        display_result_set(modified_metadata, all_columns, modified_data);
+
+        // Verify data integrity
+        print_debug("Verifying new data\n");
+        for (size_t i = 0; i < all_columns.size(); ++i)
+        {
+            std::string column_name = all_columns[i];
+            // Check if original data is preserved
+            assert(std::equal(original_data[i].begin(), original_data[i].end(), modified_data[i].begin()) && 
+                   "Original data not preserved");
+            // Check if new rows are correctly added
             for (size_t j = 0; j < new_rows.size(); ++j)
             {
                 int expected_value = new_rows[j][i];
@@ -600,6 +2583,206 @@ int main()
                 assert(expected_value == actual_value && "New row data mismatch");
             }
         }
+
+        // Test hash_join
+        std::cout << std::endl << "----------Hash Join----------" << std::endl;
+        JoinSide left{metadata, hty_file_path, "id", {"id", "salary"}, {{"salary", 2, 50000.0f}}};
+        JoinSide right{modified_metadata, modified_hty_file_path, "id", {"rating"}, {}};
+        std::vector<std::vector<int>> joined_data = hash_join(left, right);
+        display_result_set(metadata, {"id", "salary", "rating"}, joined_data);
+        assert(joined_data[0] == filtered_data[0] && "Join keys mismatch");
+        assert(joined_data[1] == filtered_data[2] && "Join left column mismatch");
+        assert(joined_data[2] == filtered_data[3] && "Join right column mismatch");
+
+        // Test project_expressions
+        std::cout << std::endl << "----------Expressions----------" << std::endl;
+        ExprPtr raised_salary = expr_binary(ExprKind::Multiply, expr_column("salary"), expr_literal(1.1f));
+        ExprPtr low_salary = expr_binary(ExprKind::Less, expr_column("salary"), expr_literal(50000));
+        std::vector<std::vector<int>> computed_data = project_expressions(metadata, hty_file_path, {expr_column("id"), raised_salary}, low_salary);
+        assert(expression_type(metadata, raised_salary) == "float" && "Expression type mismatch");
+        assert(expr_literal(1.1)->float_value == 1.1f && "Double literal mismatch");
+        assert(computed_data[0] == filtered_data[0] && "Expression filter mismatch");
+        for (size_t i = 0; i < computed_data[1].size(); ++i)
+        {
+            float salary;
+            float computed;
+            std::memcpy(&salary, &filtered_data[2][i], sizeof(float));
+            std::memcpy(&computed, &computed_data[1][i], sizeof(float));
+            print_debug("id %d: salary * 1.1 = %f\n", computed_data[0][i], computed);
+            assert(computed == salary * 1.1f && "Computed column mismatch");
+        }
+        export_result_set({"id", "raised_salary"}, {"int", expression_type(metadata, raised_salary)}, std::move(computed_data),
+                          &schema, &array);
+        assert(std::string(schema.children[1]->format) == "f" && "Computed column exported with the wrong Arrow type");
+        array.release(&array);
+        schema.release(&schema);
+
+        // age + id * 2 > 40 AND NOT rating = 4.0
+        ExprPtr predicate = expr_binary(ExprKind::And,
+            expr_binary(ExprKind::Greater,
+                expr_binary(ExprKind::Add, expr_column("age"), expr_binary(ExprKind::Multiply, expr_column("id"), expr_literal(2))),
+                expr_literal(40)),
+            expr_unary(ExprKind::Not, expr_binary(ExprKind::Equal, expr_column("rating"), expr_literal(4.0f))));
+        computed_data = project_expressions(metadata, hty_file_path, {expr_column("id")}, predicate);
+        std::vector<int> expected_ids;
+        for (size_t row = 0; row < all_data[0].size(); ++row)
+        {
+            float rating;
+            std::memcpy(&rating, &all_data[3][row], sizeof(float));
+            if (all_data[1][row] + all_data[0][row] * 2 > 40 && rating != 4.0f)
+            {
+                expected_ids.push_back(all_data[0][row]);
+            }
+        }
+        assert(computed_data[0] == expected_ids && "Expression predicate mismatch");
+
+        // Int arithmetic wraps instead of overflowing
+        ExprPtr wrapped = expr_binary(ExprKind::Add,
+            expr_binary(ExprKind::Multiply, expr_column("id"), expr_literal(INT_MAX)), expr_literal(INT_MAX));
+        computed_data = project_expressions(metadata, hty_file_path, {wrapped}, nullptr);
+        for (size_t row = 0; row < all_data[0].size(); ++row)
+        {
+            unsigned expected = static_cast<unsigned>(all_data[0][row]) * static_cast<unsigned>(INT_MAX) + static_cast<unsigned>(INT_MAX);
+            assert(computed_data[0][row] == static_cast<int>(expected) && "Wrapping arithmetic mismatch");
+        }
+
+        // Float to int casts truncate, clamp out-of-range values and turn NaN into 0
+        ExprPtr salary = expr_column("salary");
+        ExprPtr not_a_number = expr_binary(ExprKind::Divide, expr_binary(ExprKind::Subtract, salary, salary),
+                                           expr_binary(ExprKind::Subtract, salary, salary));
+        computed_data = project_expressions(metadata, hty_file_path,
+            {expr_unary(ExprKind::CastInt, expr_column("rating")),
+             expr_unary(ExprKind::CastInt, expr_binary(ExprKind::Multiply, salary, expr_literal(1e6f))),
+             expr_unary(ExprKind::CastInt, expr_binary(ExprKind::Multiply, salary, expr_literal(-1e6f))),
+             expr_unary(ExprKind::CastInt, not_a_number)}, nullptr);
+        for (size_t row = 0; row < all_data[0].size(); ++row)
+        {
+            float rating;
+            std::memcpy(&rating, &all_data[3][row], sizeof(float));
+            assert(computed_data[0][row] == static_cast<int>(rating) && "Float to int cast mismatch");
+            assert(computed_data[1][row] == INT_MAX && computed_data[2][row] == INT_MIN && "Float to int clamp mismatch");
+            assert(computed_data[3][row] == 0 && "NaN to int cast mismatch");
+        }
+
+        // Test the server protocol over a socket pair
+        std::cout << std::endl << "----------Server----------" << std::endl;
+        int sockets[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) < 0)
+        {
+            throw std::runtime_error("Unable to create socket pair");
+        }
+        send_all(sockets[0], "PROJECT " + hty_file_path + " id,salary\n"
+                             "FILTER " + hty_file_path + " salary 2 50000\n"
+                             "SELECT " + hty_file_path + " id salary 2 50000\n"
+                             "FILTER " + hty_file_path + " nope 0 1\n"
+                             "QUIT\n");
+        {
+            Server server;
+            ThreadPool pool(min_server_threads);
+            handle_connection(server, pool, sockets[1]);
+        }
+        std::string responses;
+        char buffer[4096];
+        ssize_t received;
+        while ((received = recv(sockets[0], buffer, sizeof(buffer), 0)) > 0)
+        {
+            responses.append(buffer, static_cast<size_t>(received));
+        }
+        close(sockets[0]);
+
+        auto expected_response = [](const std::string& header, const std::vector<std::vector<int>>& columns, const std::vector<bool>& is_float)
+        {
+            std::string out = "OK " + std::to_string(columns.size()) + " " + std::to_string(columns[0].size()) + "\n" + header + "\n";
+            for (size_t row = 0; row < columns[0].size(); ++row)
+            {
+                for (size_t col = 0; col < columns.size(); ++col)
+                {
+                    out += (col == 0) ? "" : ",";
+                    append_value(out, columns[col][row], is_float[col]);
+                }
+                out += "\n";
+            }
+            return out + "END\n";
+        };
+        std::string expected_responses = expected_response("id,salary", {all_data[0], all_data[2]}, {false, true})
+                                       + expected_response("index", {filtered_indices}, {false})
+                                       + expected_response("id", {filtered_data[0]}, {false})
+                                       + "ERR Column not found: nope\n";
+        print_debug("Server responses: %zu bytes\n", responses.size());
+        assert(responses == expected_responses && "Server responses mismatch");
+
+        // Test a file with several groups, laid out as {id, salary} then {age, rating}
+        // (the advisor and the rewrite themselves are checked by `regroup.out --check`)
+        std::cout << std::endl << "----------Multiple groups----------" << std::endl;
+        std::string regrouped_hty_file_path = "test/regrouped_test.hty";
+        {
+            std::vector<std::vector<std::string>> group_columns = {{"id", "salary"}, {"age", "rating"}};
+            std::vector<std::vector<size_t>> group_indices = {{0, 2}, {1, 3}};
+            std::ofstream out_file(regrouped_hty_file_path, std::ios::binary);
+            json regrouped_metadata = {{"num_rows", metadata["num_rows"]}, {"num_groups", group_columns.size()}, {"groups", json::array()}};
+            int64_t offset = 0;
+            for (size_t g = 0; g < group_columns.size(); ++g)
+            {
+                json columns_metadata = json::array();
+                for (size_t i = 0; i < group_columns[g].size(); ++i)
+                {
+                    const std::vector<int>& column = all_data[group_indices[g][i]];
+                    out_file.write(reinterpret_cast<const char*>(column.data()), column.size() * sizeof(int));
+                    columns_metadata.push_back({{"column_name", group_columns[g][i]},
+                                                {"column_type", find_column_type(metadata, group_columns[g][i])}});
+                }
+                regrouped_metadata["groups"].push_back({{"num_columns", group_columns[g].size()}, {"offset", offset}, {"columns", columns_metadata}});
+                offset += static_cast<int64_t>(group_columns[g].size() * all_data[0].size() * sizeof(int));
+            }
+            std::string metadata_str = regrouped_metadata.dump();
+            int metadata_size = static_cast<int>(metadata_str.size());
+            out_file.write(metadata_str.c_str(), metadata_str.size());
+            out_file.write(reinterpret_cast<const char*>(&metadata_size), sizeof(int));
+            if (!out_file)
+            {
+                throw std::runtime_error("Failed to write " + regrouped_hty_file_path);
+            }
+        }
+
+        json regrouped_metadata = extract_metadata(regrouped_hty_file_path);
+        std::vector<std::string> original_columns = {"id", "age", "salary", "rating"};
+        assert(project(regrouped_metadata, regrouped_hty_file_path, original_columns) == all_data && "Regrouped project mismatch");
+        std::vector<std::vector<int>> repeated_data = project(regrouped_metadata, regrouped_hty_file_path, {"salary", "age", "salary"});
+        assert(repeated_data[0] == all_data[2] && repeated_data[1] == all_data[1] && repeated_data[2] == all_data[2] &&
+               "Regrouped project of repeated columns mismatch");
+        std::vector<std::vector<int>> regrouped_filtered_data =
+            project_and_filter(regrouped_metadata, regrouped_hty_file_path, original_columns, "salary", 2, 50000.0f);
+        assert(regrouped_filtered_data == filtered_data && "Regrouped project_and_filter mismatch");
+
+        // add_row on a file with several groups has to keep every group's offset right
+        // (add_row takes row values in the order the metadata lists the columns)
+        std::vector<std::vector<int>> regrouped_new_rows(new_rows.size());
+        for (const auto& group : regrouped_metadata["groups"])
+        {
+            for (const auto& column : group["columns"])
+            {
+                size_t i = std::find(original_columns.begin(), original_columns.end(), column["column_name"].get<std::string>())
+                         - original_columns.begin();
+                for (size_t j = 0; j < new_rows.size(); ++j)
+                {
+                    regrouped_new_rows[j].push_back(new_rows[j][i]);
+                }
+            }
+        }
+        std::string regrouped_modified_hty_file_path = "test/regrouped_modified_test.hty";
+        add_row(regrouped_metadata, regrouped_hty_file_path, regrouped_modified_hty_file_path, regrouped_new_rows);
+        json regrouped_modified_metadata = extract_metadata(regrouped_modified_hty_file_path);
+        std::vector<std::vector<int>> regrouped_modified_data =
+            project(regrouped_modified_metadata, regrouped_modified_hty_file_path, original_columns);
+        for (size_t i = 0; i < original_columns.size(); ++i)
+        {
+            std::vector<int> expected_column = all_data[i];
+            for (const auto& row : new_rows)
+            {
+                expected_column.push_back(row[i]);
+            }
+            assert(regrouped_modified_data[i] == expected_column && "Regrouped add_row mismatch");
+        }
     }
     catch (const std::exception& e)
     {
@@ -0,0 +1,547 @@
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <numeric>
+#include <set>
+#include <string>
+#include <vector>
+#include "../third_party/nlohmann/json.hpp"
+
+using json = nlohmann::json;
+
+// Bytes copied per read/write when rewriting a file
+const size_t copy_chunk_bytes = 1 << 20;
+
+// Represents a column of the source HTY file
+struct Column
+{
+    std::string name;
+    std::string type;
+    int64_t offset;  // Offset of the column's data in the source file
+};
+
+// A distinct set of columns touched by logged queries, with its frequency
+struct QueryPattern
+{
+    std::vector<size_t> columns;
+    int64_t count;
+};
+
+// Reads the metadata of an HTY file
+// Input: Path to HTY file
+// Output: JSON object containing metadata
+json read_metadata(const std::string& hty_file_path)
+{
+    std::ifstream file(hty_file_path, std::ios::binary | std::ios::ate);
+    if (!file.is_open())
+    {
+        throw std::runtime_error("Unable to open file " + hty_file_path);
+    }
+
+    std::streamsize size = file.tellg();
+    file.seekg(size - sizeof(int));
+    int metadata_size;
+    file.read(reinterpret_cast<char*>(&metadata_size), sizeof(int));
+
+    file.seekg(size - metadata_size - sizeof(int));
+    std::string metadata_str(metadata_size, '\0');
+    file.read(&metadata_str[0], metadata_size);
+    return json::parse(metadata_str);
+}
+
+// Lists the columns of an HTY file in file order
+// Input: Metadata
+// Output: Columns with the offsets of their data
+std::vector<Column> list_columns(const json& metadata)
+{
+    int64_t num_rows = metadata["num_rows"].get<int64_t>();
+    std::vector<Column> columns;
+    for (const auto& group : metadata["groups"])
+    {
+        int64_t base_offset = group["offset"].get<int64_t>();
+        for (size_t i = 0; i < group["columns"].size(); ++i)
+        {
+            columns.push_back({group["columns"][i]["column_name"].get<std::string>(),
+                               group["columns"][i]["column_type"].get<std::string>(),
+                               base_offset + static_cast<int64_t>(i) * num_rows * static_cast<int64_t>(sizeof(int))});
+        }
+    }
+    return columns;
+}
+
+// Reads the queries logged against one table
+// A line cut short by a process killed mid-write is skipped and counted on
+// stderr rather than failing the whole run.
+// Input: Path to query log, HTY file path, columns of the table
+// Output: Distinct column sets touched by the queries, with their frequency
+std::vector<QueryPattern> read_query_log(const std::string& query_log_path, const std::string& hty_file_path,
+                                         const std::vector<Column>& columns)
+{
+    std::ifstream log_file(query_log_path);
+    if (!log_file.is_open())
+    {
+        throw std::runtime_error("Unable to open query log " + query_log_path);
+    }
+
+    std::map<std::string, size_t> column_index;
+    for (size_t i = 0; i < columns.size(); ++i)
+    {
+        column_index[columns[i].name] = i;
+    }
+
+    std::string table_path = std::filesystem::weakly_canonical(hty_file_path).string();
+    std::map<std::vector<size_t>, int64_t> counts;
+    int64_t skipped_lines = 0;
+    std::string line;
+    while (std::getline(log_file, line))
+    {
+        if (line.empty())
+        {
+            continue;
+        }
+        json entry = json::parse(line, nullptr, false);
+        if (entry.is_discarded() || !entry.is_object() || !entry.contains("hty_file_path") ||
+            !entry["hty_file_path"].is_string() || !entry.contains("columns") || !entry["columns"].is_array())
+        {
+            skipped_lines++;
+            continue;
+        }
+        if (entry["hty_file_path"].get<std::string>() != table_path)
+        {
+            continue;
+        }
+
+        std::set<size_t> touched;
+        for (const auto& column_name : entry["columns"])
+        {
+            if (!column_name.is_string())
+            {
+                continue;
+            }
+            auto it = column_index.find(column_name.get<std::string>());
+            if (it != column_index.end())
+            {
+                touched.insert(it->second);
+            }
+        }
+        if (!touched.empty())
+        {
+            counts[std::vector<size_t>(touched.begin(), touched.end())]++;
+        }
+    }
+    if (skipped_lines > 0)
+    {
+        std::cerr << "Skipped " << skipped_lines << " malformed line(s) in " << query_log_path << std::endl;
+    }
+
+    std::vector<QueryPattern> patterns;
+    for (const auto& [pattern_columns, count] : counts)
+    {
+        patterns.push_back({pattern_columns, count});
+    }
+    return patterns;
+}
+
+// Counts the reads a workload issues under a column layout
+// project() reads every column it needs exactly once and fetches columns that
+// are adjacent in the file with a single read, so a query costs one read per
+// run of its columns that sit next to each other. The bytes read do not depend
+// on the layout.
+// Input: Column indices in file order, query patterns
+// Output: Number of reads
+int64_t count_reads(const std::vector<size_t>& layout, const std::vector<QueryPattern>& patterns)
+{
+    std::vector<size_t> position(layout.size());
+    for (size_t p = 0; p < layout.size(); ++p)
+    {
+        position[layout[p]] = p;
+    }
+
+    int64_t reads = 0;
+    for (const auto& pattern : patterns)
+    {
+        std::vector<size_t> positions;
+        for (size_t column : pattern.columns)
+        {
+            positions.push_back(position[column]);
+        }
+        std::sort(positions.begin(), positions.end());
+        for (size_t i = 0; i < positions.size(); ++i)
+        {
+            if (i == 0 || positions[i] != positions[i - 1] + 1)
+            {
+                reads += pattern.count;
+            }
+        }
+    }
+    return reads;
+}
+
+// Counts the bytes a workload reads, which is the same under every layout
+// Input: Query patterns, number of rows
+// Output: Number of bytes
+int64_t count_bytes(const std::vector<QueryPattern>& patterns, int64_t num_rows)
+{
+    int64_t bytes = 0;
+    for (const auto& pattern : patterns)
+    {
+        bytes += pattern.count * static_cast<int64_t>(pattern.columns.size()) * num_rows * static_cast<int64_t>(sizeof(int));
+    }
+    return bytes;
+}
+
+// Concatenates the groups of a grouping into a file layout
+std::vector<size_t> flatten_groups(const std::vector<std::vector<size_t>>& groups)
+{
+    std::vector<size_t> layout;
+    for (const auto& group : groups)
+    {
+        layout.insert(layout.end(), group.begin(), group.end());
+    }
+    return layout;
+}
+
+// Computes a column grouping that minimizes the reads issued by the workload
+// Columns touched by queries start in groups of their own. Appending group B
+// after group A saves one read for every query using both the last column of
+// A and the first column of B, so the pair (and order) saving the most is
+// merged until no merge saves anything. Each resulting group is a chain of
+// columns queried together. Columns no query touches are kept together in a
+// final group.
+// Input: Number of columns, query patterns
+// Output: Column indices per group, in the order they are laid out
+std::vector<std::vector<size_t>> advise_grouping(size_t num_columns, const std::vector<QueryPattern>& patterns)
+{
+    std::vector<bool> used(num_columns, false);
+    for (const auto& pattern : patterns)
+    {
+        for (size_t column : pattern.columns)
+        {
+            used[column] = true;
+        }
+    }
+
+    std::vector<std::vector<size_t>> groups;
+    for (size_t column = 0; column < num_columns; ++column)
+    {
+        if (used[column])
+        {
+            groups.push_back({column});
+        }
+    }
+
+    // Reads saved by laying column b right after column a
+    auto adjacency_saving = [&patterns](size_t a, size_t b)
+    {
+        int64_t saving = 0;
+        for (const auto& pattern : patterns)
+        {
+            if (std::binary_search(pattern.columns.begin(), pattern.columns.end(), a) &&
+                std::binary_search(pattern.columns.begin(), pattern.columns.end(), b))
+            {
+                saving += pattern.count;
+            }
+        }
+        return saving;
+    };
+
+    while (groups.size() > 1)
+    {
+        int64_t best_saving = 0;
+        size_t best_first = 0;
+        size_t best_second = 0;
+        for (size_t a = 0; a < groups.size(); ++a)
+        {
+            for (size_t b = 0; b < groups.size(); ++b)
+            {
+                if (a == b)
+                {
+                    continue;
+                }
+                int64_t saving = adjacency_saving(groups[a].back(), groups[b].front());
+                if (saving > best_saving)
+                {
+                    best_saving = saving;
+                    best_first = a;
+                    best_second = b;
+                }
+            }
+        }
+        if (best_saving <= 0)
+        {
+            break;
+        }
+
+        groups[best_first].insert(groups[best_first].end(), groups[best_second].begin(), groups[best_second].end());
+        groups.erase(groups.begin() + best_second);
+    }
+
+    std::sort(groups.begin(), groups.end(),
+              [](const auto& a, const auto& b) { return *std::min_element(a.begin(), a.end()) < *std::min_element(b.begin(), b.end()); });
+    std::vector<size_t> cold_columns;
+    for (size_t column = 0; column < num_columns; ++column)
+    {
+        if (!used[column])
+        {
+            cold_columns.push_back(column);
+        }
+    }
+    if (!cold_columns.empty())
+    {
+        groups.push_back(cold_columns);
+    }
+    return groups;
+}
+
+// Writes the columns of an HTY file into a new file with a new column grouping
+// Column data is copied in fixed-size chunks, so the file is never loaded whole.
+// Input: Source metadata, source HTY file path, output HTY file path, columns, grouping
+void write_regrouped_hty(const json& metadata, const std::string& hty_file_path, const std::string& output_hty_file_path,
+                         const std::vector<Column>& columns, const std::vector<std::vector<size_t>>& groups)
+{
+    std::ifstream in_file(hty_file_path, std::ios::binary);
+    if (!in_file.is_open())
+    {
+        throw std::runtime_error("Unable to open file " + hty_file_path);
+    }
+    std::ofstream out_file(output_hty_file_path, std::ios::binary);
+    if (!out_file.is_open())
+    {
+        throw std::runtime_error("Unable to open output file " + output_hty_file_path);
+    }
+
+    int64_t num_rows = metadata["num_rows"].get<int64_t>();
+    int64_t column_bytes = num_rows * static_cast<int64_t>(sizeof(int));
+    std::vector<char> buffer(copy_chunk_bytes);
+
+    json new_metadata;
+    new_metadata["num_rows"] = metadata["num_rows"];
+    new_metadata["num_groups"] = groups.size();
+    new_metadata["groups"] = json::array();
+    int64_t offset = 0;
+    for (const auto& group : groups)
+    {
+        json group_metadata;
+        group_metadata["num_columns"] = group.size();
+        group_metadata["offset"] = offset;
+        json columns_metadata = json::array();
+        for (size_t column : group)
+        {
+            columns_metadata.push_back({{"column_name", columns[column].name}, {"column_type", columns[column].type}});
+
+            // Stream the column's data to the end of the output
+            in_file.seekg(columns[column].offset, std::ios::beg);
+            int64_t remaining = column_bytes;
+            while (remaining > 0)
+            {
+                std::streamsize chunk = static_cast<std::streamsize>(std::min<int64_t>(remaining, buffer.size()));
+                in_file.read(buffer.data(), chunk);
+                if (!in_file)
+                {
+                    throw std::runtime_error("Failed to read data for column " + columns[column].name);
+                }
+                out_file.write(buffer.data(), chunk);
+                remaining -= chunk;
+            }
+            offset += column_bytes;
+        }
+        group_metadata["columns"] = columns_metadata;
+        new_metadata["groups"].push_back(group_metadata);
+    }
+
+    // Write metadata
+    std::string metadata_str = new_metadata.dump();
+    out_file.write(metadata_str.c_str(), metadata_str.size());
+
+    // Write metadata size
+    int metadata_size = static_cast<int>(metadata_str.size());
+    out_file.write(reinterpret_cast<const char*>(&metadata_size), sizeof(int));
+
+    out_file.close();
+    if (!out_file)
+    {
+        throw std::runtime_error("Failed to write " + output_hty_file_path);
+    }
+}
+
+// Rewrites an HTY file into a new column grouping
+// The new file is written next to the output and renamed over it once
+// complete, so the output may be the input file itself.
+// Input: Source metadata, source HTY file path, output HTY file path, columns, grouping
+void rewrite_hty(const json& metadata, const std::string& hty_file_path, const std::string& output_hty_file_path,
+                 const std::vector<Column>& columns, const std::vector<std::vector<size_t>>& groups)
+{
+    std::string temp_file_path = output_hty_file_path + ".tmp";
+    try
+    {
+        write_regrouped_hty(metadata, hty_file_path, temp_file_path, columns, groups);
+        std::filesystem::rename(temp_file_path, output_hty_file_path);
+    }
+    catch (const std::exception&)
+    {
+        std::error_code ignored;
+        std::filesystem::remove(temp_file_path, ignored);
+        throw;
+    }
+}
+
+// Prints a column grouping
+// Input: Columns, grouping
+void display_grouping(const std::vector<Column>& columns, const std::vector<std::vector<size_t>>& groups)
+{
+    for (size_t g = 0; g < groups.size(); ++g)
+    {
+        std::cout << "Group " << g << ":";
+        for (size_t column : groups[g])
+        {
+            std::cout << " " << columns[column].name;
+        }
+        std::cout << std::endl;
+    }
+}
+
+// Reads the raw bytes of one column
+// Input: HTY file path, column, number of rows
+// Output: The column's bytes
+std::vector<char> read_column_bytes(const std::string& hty_file_path, const Column& column, int64_t num_rows)
+{
+    std::ifstream file(hty_file_path, std::ios::binary);
+    if (!file.is_open())
+    {
+        throw std::runtime_error("Unable to open file " + hty_file_path);
+    }
+    std::vector<char> bytes(num_rows * sizeof(int));
+    file.seekg(column.offset, std::ios::beg);
+    file.read(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+    if (!file)
+    {
+        throw std::runtime_error("Failed to read data for column " + column.name);
+    }
+    return bytes;
+}
+
+// Checks the advisor and the rewrite against an HTY file with at least four columns
+// The workload queries the first column with the last and the second with the
+// third, so the advisor has to split them into two chains. The file is then
+// rewritten twice, the second time in place, and every column must keep its data.
+// Input: HTY file path (left unchanged)
+void check_regrouping(const std::string& hty_file_path)
+{
+    json metadata = read_metadata(hty_file_path);
+    int64_t num_rows = metadata["num_rows"].get<int64_t>();
+    std::vector<Column> columns = list_columns(metadata);
+    assert(columns.size() >= 4 && "Check needs at least four columns");
+
+    std::string output_hty_file_path = hty_file_path + ".regrouped";
+    std::string query_log_path = output_hty_file_path + ".jsonl";
+    {
+        std::ofstream query_log(query_log_path);
+        std::string table_path = std::filesystem::weakly_canonical(hty_file_path).string();
+        for (const auto& pair : {std::vector<std::string>{columns[0].name, columns.back().name},
+                                 std::vector<std::string>{columns[1].name, columns[2].name}})
+        {
+            query_log << json({{"hty_file_path", table_path}, {"columns", pair}}).dump() << std::endl;
+        }
+        query_log << "{\"hty_file_path\": \"" << table_path << "\", \"colu" << std::endl;  // Torn line
+    }
+    std::vector<QueryPattern> patterns = read_query_log(query_log_path, hty_file_path, columns);
+    assert(patterns.size() == 2 && "Query log patterns mismatch");
+
+    std::vector<size_t> current_layout(columns.size());
+    std::iota(current_layout.begin(), current_layout.end(), 0);
+    std::vector<std::vector<size_t>> groups = advise_grouping(columns.size(), patterns);
+    assert(groups.size() >= 2 && "Advisor kept a single group");
+    assert(count_reads(flatten_groups(groups), patterns) == 2 && "Advised layout does not read each pair at once");
+    assert(count_reads(flatten_groups(groups), patterns) <= count_reads(current_layout, patterns) && "Advised layout reads more");
+
+    // Second rewrite in place: one group per column, in reverse order
+    rewrite_hty(metadata, hty_file_path, output_hty_file_path, columns, groups);
+    std::vector<std::vector<size_t>> reversed_groups;
+    for (size_t column = columns.size(); column-- > 0;)
+    {
+        reversed_groups.push_back({column});
+    }
+    json advised_metadata = read_metadata(output_hty_file_path);
+    rewrite_hty(advised_metadata, output_hty_file_path, output_hty_file_path, list_columns(advised_metadata), reversed_groups);
+    json regrouped_metadata = read_metadata(output_hty_file_path);
+    std::vector<Column> regrouped_columns = list_columns(regrouped_metadata);
+    assert(regrouped_metadata["num_rows"].get<int64_t>() == num_rows && "Regrouped row count mismatch");
+    assert(regrouped_columns.size() == columns.size() && "Regrouped column count mismatch");
+    for (const auto& column : columns)
+    {
+        auto it = std::find_if(regrouped_columns.begin(), regrouped_columns.end(),
+                               [&column](const Column& c) { return c.name == column.name; });
+        assert(it != regrouped_columns.end() && it->type == column.type && "Regrouped column missing");
+        assert(read_column_bytes(output_hty_file_path, *it, num_rows) == read_column_bytes(hty_file_path, column, num_rows) &&
+               "Regrouped column data mismatch");
+    }
+
+    std::filesystem::remove(output_hty_file_path);
+    std::filesystem::remove(query_log_path);
+    std::cout << "Regrouping checks passed." << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc == 3 && std::string(argv[1]) == "--check")
+    {
+        try
+        {
+            check_regrouping(argv[2]);
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "Error during regrouping check: " << e.what() << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    if (argc != 3 && argc != 4)
+    {
+        std::cerr << "Usage: " << argv[0] << " <query_log> <input_hty_file> [output_hty_file]" << std::endl;
+        std::cerr << "       " << argv[0] << " --check <input_hty_file>" << std::endl;
+        return 1;
+    }
+
+    std::string query_log_path = argv[1];
+    std::string hty_file_path = argv[2];
+
+    try
+    {
+        json metadata = read_metadata(hty_file_path);
+        int64_t num_rows = metadata["num_rows"].get<int64_t>();
+        std::vector<Column> columns = list_columns(metadata);
+        std::vector<QueryPattern> patterns = read_query_log(query_log_path, hty_file_path, columns);
+
+        // Current layout: columns in file order
+        std::vector<size_t> current_layout(columns.size());
+        std::iota(current_layout.begin(), current_layout.end(), 0);
+        std::stable_sort(current_layout.begin(), current_layout.end(),
+                         [&columns](size_t a, size_t b) { return columns[a].offset < columns[b].offset; });
+        std::vector<std::vector<size_t>> groups = advise_grouping(columns.size(), patterns);
+
+        std::cout << "Query patterns: " << patterns.size() << std::endl;
+        std::cout << "Reads issued by project (current): " << count_reads(current_layout, patterns) << std::endl;
+        std::cout << "Reads issued by project (advised): " << count_reads(flatten_groups(groups), patterns) << std::endl;
+        std::cout << "Bytes read (any layout): " << count_bytes(patterns, num_rows) << std::endl;
+        display_grouping(columns, groups);
+
+        if (argc == 4)
+        {
+            rewrite_hty(metadata, hty_file_path, argv[3], columns, groups);
+            std::cout << "Regrouping completed successfully." << std::endl;
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Error during regrouping: " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}